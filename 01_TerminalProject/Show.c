@@ -1,88 +1,301 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <ncurses.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <locale.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapguard.h"
+#include "screen.h"
+#include "search.h"
+#include "text.h"
 
 #define DX 3
 #define DY 3
 
-int main(int argc, char *argv[]) {
-    WINDOW *win;
-    FILE *file;
-    int ch;
-    int line_count = 0;
-    char **lines = NULL;
-    int max_win_lines, max_win_cols;
-    int current_top_line = 0;
-    int current_left_col = 0; 
+// --- Follow mode (tail -f) ---
+// The file is watched for writes and truncation, its directory for a new
+// file appearing under the same name (log rotation). Between events the
+// pager sleeps in poll(), so an idle log costs no CPU.
+struct follow {
+    int ifd;        // inotify instance, -1 when not following
+    int fd;         // the file being shown
+    int file_wd;
+    int dir_wd;
+    const char *path;
+    char name[NAME_MAX + 1];
+    ino_t ino;
+};
+
+enum { FOLLOW_NONE, FOLLOW_GREW, FOLLOW_RESET, FOLLOW_FAIL };
+
+#define FILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+static void follow_stop(struct follow *f) {
+    if (f->ifd != -1) close(f->ifd);
+    if (f->fd != -1) close(f->fd);
+    f->ifd = f->fd = -1;
+}
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
-        return 1;
+static int follow_start(struct follow *f, const char *path) {
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    struct stat st;
+
+    f->path = path;
+    f->fd = open(path, O_RDONLY | O_CLOEXEC);
+    f->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (f->fd == -1 || f->ifd == -1 || fstat(f->fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        follow_stop(f);
+        return -1;
     }
-
-    file = fopen(argv[1], "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return 1;
+    f->ino = st.st_ino;
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+        snprintf(f->name, sizeof(f->name), "%s", path);
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+        snprintf(f->name, sizeof(f->name), "%s", slash + 1);
     }
+    f->file_wd = inotify_add_watch(f->ifd, path, FILE_EVENTS);
+    f->dir_wd = inotify_add_watch(f->ifd, dir, IN_CREATE | IN_MOVED_TO);
+    if (f->file_wd == -1 || f->dir_wd == -1) {
+        follow_stop(f);
+        return -1;
+    }
+    return 0;
+}
 
-    // --- Read the entire file into memory ---
-
+// The path now names a different file: show that one from its start.
+static int follow_reopen(struct follow *f, struct text *t) {
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
 
-    int c;
-    while ((c = fgetc(file)) != EOF) {
-        if (c == '\n') {
-            line_count++;
-        }
+    if (fd == -1) return FOLLOW_NONE; // gone again; keep the old contents
+    if (fstat(fd, &st) == -1 || st.st_ino == f->ino) {
+        close(fd);
+        return FOLLOW_NONE;
+    }
+    inotify_rm_watch(f->ifd, f->file_wd);
+    f->file_wd = inotify_add_watch(f->ifd, f->path, FILE_EVENTS);
+    close(f->fd);
+    f->fd = fd;
+    f->ino = st.st_ino;
+
+    if (t->mapped) munmap((void *)t->data, t->size);
+    t->data = NULL;
+    t->size = 0;
+    t->mapped = 0;
+    t->count = 0;
+    t->indexed = 0;
+    if (st.st_size > 0) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) return FOLLOW_FAIL;
+        t->data = m;
+        t->size = (size_t)st.st_size;
+        t->mapped = 1;
     }
+    return FOLLOW_RESET;
+}
 
-    if (ftell(file) > 0) {
-        fseek(file, -1, SEEK_END);
-        if (fgetc(file) != '\n') {
-            line_count++;
+// Drain pending inotify events and bring `t` up to date with the file.
+static int follow_update(struct follow *f, struct text *t) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int file_changed = 0, renamed = 0;
+    ssize_t n;
+
+    while ((n = read(f->ifd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->wd == f->file_wd)
+                file_changed = 1;
+            else if (ev->wd == f->dir_wd && ev->len > 0 && strcmp(ev->name, f->name) == 0)
+                renamed = 1;
+            p += sizeof(*ev) + ev->len;
         }
     }
 
-
-    lines = (char **)malloc(line_count * sizeof(char *));
-    if (lines == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        fclose(file);
-        return 1;
+    if (renamed) {
+        int r = follow_reopen(f, t);
+        if (r != FOLLOW_NONE) return r;
     }
+    if (file_changed) {
+        struct stat st;
+        size_t old = t->size;
+        if (fstat(f->fd, &st) == -1) return FOLLOW_FAIL;
+        if (!t->mapped && t->size > 0) return FOLLOW_NONE; // not a mapped file
+        if (resize_text(t, f->fd, (size_t)st.st_size) != 0) return FOLLOW_FAIL;
+        if (t->size < old) return FOLLOW_RESET;
+        if (t->size > old) return FOLLOW_GREW;
+    }
+    return FOLLOW_NONE;
+}
 
+// A read past the end of a file truncated under the mapping faulted
+// before inotify told us (see mapguard.h): map what is left of it and
+// index it from the start.
+static int refit_text(struct text *t, int fd) {
+    struct stat st;
 
-    fseek(file, 0, SEEK_SET);
-    char buffer[4096]; // Use a larger buffer for longer lines
-    int current_line = 0;
-
-    while (fgets(buffer, sizeof(buffer), file) != NULL && current_line < line_count) {
+    if (fstat(fd, &st) == -1) return -1;
+    t->count = 0;
+    t->indexed = 0;
+    return resize_text(t, fd, (size_t)st.st_size);
+}
 
-        int len = strlen(buffer);
-        if (len > 0 && buffer[len - 1] == '\n') {
-            buffer[len - 1] = '\0';
-            len--;
-        }
+static void draw_status(WINDOW *win, const struct text *t, size_t top, int following,
+                        const char *note) {
+    char status[256];
+    size_t line;
+    int len;
+
+    if (find_line(t, top, &line))
+        len = snprintf(status, sizeof(status), " line %zu/%zu", line + 1, t->count);
+    else
+        len = snprintf(status, sizeof(status), " line ?/%zu", t->count);
+    if (!index_complete(t))
+        len += snprintf(status + len, sizeof(status) - len, "+ (%d%%)", index_percent(t));
+    if (following)
+        len += snprintf(status + len, sizeof(status) - len, " [follow]");
+    if (note[0] != '\0')
+        len += snprintf(status + len, sizeof(status) - len, " | %s", note);
+    snprintf(status + len, sizeof(status) - len, " ");
+
+    mvwhline(win, getmaxy(win) - 1, 1, ACS_HLINE, getmaxx(win) - 2);
+    if (getmaxx(win) > 4) mvwaddnstr(win, getmaxy(win) - 1, 2, status, getmaxx(win) - 4);
+}
 
 
-        lines[current_line] = (char *)malloc((len + 1) * sizeof(char));
-        if (lines[current_line] == NULL) {
-            fprintf(stderr, "Memory allocation failed\n");
+// Pseudo keys returned by wait_key() besides real key codes
+enum {
+    EV_PROGRESS = KEY_MAX + 1, // the index advanced; only the status line changed
+    EV_GREW,                   // the followed file grew
+    EV_RESET,                  // the followed file was truncated or replaced
+    EV_SEARCH,                 // the background search published new hits
+    EV_FAIL                    // indexing or remapping failed (see errno)
+};
+
+// While the index is incomplete, poll the keyboard and scan one chunk
+// whenever no key is waiting. Once there is nothing left to do, sleep
+// until a key arrives, the followed file changes or the search reports.
+static int wait_key(WINDOW *win, struct text *t, struct follow *f, struct search *s) {
+    int percent = index_percent(t);
+    int ch;
 
-            for (int i = 0; i < current_line; i++) free(lines[i]);
-            free(lines);
-            fclose(file);
-            return 1;
+    wtimeout(win, 0);
+    for (;;) {
+        if ((ch = wgetch(win)) != ERR) return ch;
+
+        // poll() skips the negative descriptors of inactive sources
+        struct pollfd pfd[3] = {
+            { .fd = STDIN_FILENO, .events = POLLIN },
+            { .fd = f->ifd, .events = POLLIN },
+            { .fd = s ? search_fd(s) : -1, .events = POLLIN },
+        };
+        if (poll(pfd, 3, index_complete(t) ? -1 : 0) > 0) {
+            if (pfd[2].revents & POLLIN) {
+                search_drain(s);
+                return EV_SEARCH;
+            }
+            if (pfd[1].revents & POLLIN) {
+                switch (follow_update(f, t)) {
+                    case FOLLOW_GREW: return EV_GREW;
+                    case FOLLOW_RESET: return EV_RESET;
+                    case FOLLOW_FAIL: return EV_FAIL;
+                    default: break;
+                }
+            }
         }
 
-        strcpy(lines[current_line], buffer);
-        current_line++;
+        if (!index_complete(t)) {
+            if (index_chunk(t, INDEX_CHUNK) != 0) return EV_FAIL;
+            if (index_complete(t) || index_percent(t) != percent)
+                return EV_PROGRESS;
+        }
     }
+}
+
+// Read a line of input on the status line. Returns 0 unless cancelled.
+static int prompt(WINDOW *win, const char *lead, char *buf, int len) {
+    int row = getmaxy(win) - 1;
+    int col = 2 + (int)strlen(lead);
+    int room = getmaxx(win) - col - 2;
+    int rc;
+
+    mvwhline(win, row, 1, ACS_HLINE, getmaxx(win) - 2);
+    mvwaddstr(win, row, 2, lead);
+    wtimeout(win, -1);
+    echo();
+    curs_set(1);
+    rc = mvwgetnstr(win, row, col, buf, room < len ? room : len - 1);
+    curs_set(0);
+    noecho();
+    return rc == OK ? 0 : -1;
+}
 
-    fclose(file);
+int main(int argc, char *argv[]) {
+    WINDOW *win, *view;
+    struct screen screen;
+    struct text text;
+    struct follow follow = { .ifd = -1, .fd = -1 };
+    const char *path;
+    int ch;
+    int max_win_lines, max_win_cols;
+    // The volatile ones keep their value across a siglongjmp() to `bus`
+    size_t current_top = 0; // byte offset of the first visible line
+    volatile size_t current_left_col = 0;
+    int at_bottom = 0;
+    volatile int stick = 0; // End was pressed while the text was still growing
+    volatile int status = 0;
+    struct search search;
+    volatile int searching = 0;
+    char pattern[256] = "";
+    volatile int pending = 0; // direction of a jump waiting for the search
+    size_t pending_from = 0;
+    volatile size_t goto_line = 0; // a :N jump waiting for the index to reach line N
+    volatile int goto_pct = -1;    // a :N% jump waiting for a gzip file's full size
+    char message[160] = ""; // shown until the next key
+    char target[32] = "";   // what a pending :N jump was given
+    char note[160];
+    sigjmp_buf bus;         // a read of the mapping faulted (see mapguard.h)
+
+    if (argc == 3 && strcmp(argv[1], "-f") == 0) {
+        path = argv[2];
+    } else if (argc == 2) {
+        path = argv[1];
+    } else {
+        fprintf(stderr, "Usage: %s [-f] <filename>\n", argv[0]);
+        return 1;
+    }
 
+    // --- Map the file; lines are indexed while the pager is already up ---
+    if (load_text(&text, path) != 0) {
+        perror("Error opening file");
+        free_text(&text);
+        return 1;
+    }
+    if (argc == 3 && text.gz != NULL) {
+        fprintf(stderr, "Cannot follow a compressed file\n");
+        free_text(&text);
+        return 1;
+    }
+    if (argc == 3 && follow_start(&follow, path) != 0) {
+        perror("Cannot follow file");
+        free_text(&text);
+        return 1;
+    }
 
+    map_guard_init();
+    setlocale(LC_ALL, "");
     initscr();            // Start curses mode
     noecho();             // Don't echo() while we do getch
     cbreak();             // Line buffering disabled
@@ -94,76 +307,236 @@ int main(int argc, char *argv[]) {
 
     max_win_lines = getmaxy(win) - 2; // -2 for the border
     max_win_cols = getmaxx(win) - 2;  // -2 for the border
+    size_t page = max_win_lines > 0 ? (size_t)max_win_lines : 1;
+
+    // The text lives in its own window inside the border, so scrolling it
+    // never disturbs the frame and the frame is drawn only once.
+    curs_set(0);
+    view = newwin(max_win_lines, max_win_cols, DY + 1, DX + 1);
+    idlok(view, TRUE);
+    if (screen_init(&screen, view) != 0) {
+        endwin();
+        fprintf(stderr, "Memory allocation failed\n");
+        screen_free(&screen);
+        follow_stop(&follow);
+        free_text(&text);
+        return 1;
+    }
+
+    if (follow.ifd != -1) current_top = last_page_top(&text, page);
+
+    box(win, 0, 0);
+    int title_len = strlen(path);
+    int title_pos = (getmaxx(win) - title_len) / 2;
+    if (title_pos < 1) title_pos = 1;
+    mvwaddstr(win, 0, title_pos, path);
 
     // --- Main application loop ---
     while (1) {
-        werase(win); 
-        box(win, 0, 0); 
-
-        
-        int title_len = strlen(argv[1]);
-        int title_pos = (getmaxx(win) - title_len) / 2;
-        if (title_pos < 1) title_pos = 1;
-        mvwaddstr(win, 0, title_pos, argv[1]);
-
-        
-        for (int i = 0; i < max_win_lines; i++) {
-            int line_index = current_top_line + i;
-            if (line_index >= line_count) {
-                break; 
+        // Every read of the mapping below is guarded; after a fault the
+        // file is shown afresh, like a truncation reported by inotify
+        if (sigsetjmp(bus, 1) != 0) {
+            int fd = follow.fd != -1 ? follow.fd : text.fd;
+            if (refit_text(&text, fd) != 0) {
+                endwin();
+                perror("Error reading file");
+                status = 1;
+                goto cleanup;
             }
+            current_top = follow.ifd != -1 ? last_page_top(&text, page) : 0;
+            pending = 0;
+            goto_line = 0;
+            goto_pct = -1;
+            stick = 0;
+            screen_reset(&screen);
+            if (searching && search_restart(&search, fd, text.data, text.size) != 0) beep();
+        }
+        map_guard = &bus;
+
+        // A requested n/N/search jump lands as soon as the worker finds it
+        if (pending != 0) {
+            size_t hit, count, scanned;
+            search_progress(&search, &count, &scanned);
+            // A gzip search may run ahead of the pager's own decompression
+            if (search_find(&search, pending_from, pending, &hit) && hit < text.size) {
+                current_top = hit;
+                pending = 0;
+            } else if ((scanned >= text.size && text_final(&text)) ||
+                       (pending < 0 && scanned >= pending_from)) {
+                snprintf(message, sizeof(message), "Pattern not found: %s", pattern);
+                pending = 0;
+                beep();
+            }
+        }
+        // Line numbers come from the index, percentages from the size
+        if (goto_line != 0 && (goto_line <= text.count || index_complete(&text))) {
+            size_t last = last_page_top(&text, page);
+            current_top = goto_line <= text.count ? text.starts[goto_line - 1] : last;
+            if (current_top > last) current_top = last;
+            goto_line = 0;
+        }
+        if (goto_pct >= 0 && text_final(&text)) {
+            size_t last = last_page_top(&text, page);
+            size_t off = text.size / 100 * goto_pct + text.size % 100 * goto_pct / 100;
+            current_top = off < text.size ? line_start(&text, off) : last;
+            if (current_top > last) current_top = last;
+            goto_pct = -1;
+        }
+        if (message[0] != '\0') {
+            snprintf(note, sizeof(note), "%s", message);
+        } else if (goto_line != 0 || goto_pct >= 0) {
+            snprintf(note, sizeof(note), "going to %s...", target);
+        } else if (searching) {
+            size_t count, scanned;
+            search_progress(&search, &count, &scanned);
+            int len = snprintf(note, sizeof(note), "/%s: %zu line(s)", pattern, count);
+            // A long pattern fills the note: whatever follows is cut off
+            if (len < 0 || len > (int)sizeof(note) - 1) len = (int)sizeof(note) - 1;
+            if (search.failed)
+                snprintf(note + len, sizeof(note) - len, " (search failed)");
+            else if (scanned < text.size)
+                snprintf(note + len, sizeof(note) - len, " (%d%%)",
+                         (int)(scanned * 100 / text.size));
+        } else {
+            note[0] = '\0';
+        }
 
-            
-            char *line_ptr = lines[line_index];
-            int line_len = strlen(line_ptr);
+        draw_status(win, &text, current_top, follow.ifd != -1, note);
+        screen_update(&screen, &text, current_top, current_left_col);
+        at_bottom = current_top >= last_page_top(&text, page);
+
+        wnoutrefresh(win);
+        wnoutrefresh(view);
+        doupdate();
+
+        ch = wait_key(win, &text, &follow, searching ? &search : NULL);
+        if (ch != EV_SEARCH && ch != EV_PROGRESS && ch != EV_GREW) {
+            if (ch != 'n' && ch != 'N') pending = 0;
+            goto_line = 0;
+            goto_pct = -1;
+            message[0] = '\0';
+            stick = 0;
+        }
 
-            
-            if (current_left_col < line_len) {
-                 line_ptr += current_left_col;
-            } else {
-                 line_ptr = ""; 
-            }
+        switch (ch) {
+            case EV_PROGRESS: // Only the status line changed, unless gzip data arrived
+                if (stick) current_top = last_page_top(&text, page);
+                break;
 
-            
-            char display_line[max_win_cols + 1];
-            strncpy(display_line, line_ptr, max_win_cols);
-            display_line[max_win_cols] = '\0';
+            case EV_SEARCH: // Pending jumps are resolved at the top of the loop
+                break;
 
-            mvwaddstr(win, i + 1, 1, display_line);
-        }
+            case EV_GREW: // Stick to the end of the file when already there
+                if (at_bottom) current_top = last_page_top(&text, page);
+                if (searching && search_grow(&search, text.data, text.size) != 0) beep();
+                break;
+
+            case EV_RESET: // Same offsets, different contents
+                current_top = at_bottom ? last_page_top(&text, page) : 0;
+                screen_reset(&screen);
+                if (searching && search_restart(&search, follow.fd, text.data, text.size) != 0)
+                    beep();
+                break;
 
-        wrefresh(win); 
+            case '/': { // Search forward from the top line
+                char buf[sizeof(pattern)] = "";
+                if (prompt(win, "/", buf, sizeof(buf)) != 0) break;
+                if (buf[0] != '\0') {
+                    // The worker maps the file itself; only unmappable input is shared
+                    int fd = follow.fd != -1 ? follow.fd
+                             : (text.mapped || text.gz ? text.fd : -1);
+                    char err[128];
+                    if (searching) search_stop(&search);
+                    searching = 0;
+                    if (search_start(&search, buf, fd, text.data, text.size,
+                                     err, sizeof(err)) != 0) {
+                        snprintf(message, sizeof(message), "Bad pattern: %s", err);
+                        beep();
+                        break;
+                    }
+                    searching = 1;
+                    snprintf(pattern, sizeof(pattern), "%s", buf);
+                }
+                if (searching) {
+                    pending = 1;
+                    pending_from = current_top;
+                }
+                break;
+            }
 
-        ch = wgetch(win);
+            case ':': { // Go to line N, or to N% of the file
+                char buf[32] = "", *end;
+                if (prompt(win, ":", buf, sizeof(buf)) != 0 || buf[0] == '\0') break;
+                unsigned long long n = strtoull(buf, &end, 10);
+                if (buf[0] < '0' || buf[0] > '9' || (*end != '\0' && strcmp(end, "%") != 0) ||
+                    (*end == '%' && n > 100)) {
+                    snprintf(message, sizeof(message), "Bad line number: %s", buf);
+                    beep();
+                } else if (*end == '%') {
+                    goto_pct = (int)n;
+                } else {
+                    goto_line = n > 0 ? (size_t)n : 1;
+                }
+                snprintf(target, sizeof(target), "%s", buf);
+                break;
+            }
 
-        switch (ch) {
-            case ' ':
-            case KEY_DOWN: 
-                if (current_top_line + max_win_lines < line_count) {
-                    current_top_line++;
+            case 'n': // Next / previous matching line
+            case 'N':
+                if (!searching) {
+                    beep();
+                    break;
                 }
+                pending = ch == 'n' ? 1 : -1;
+                pending_from = ch == 'n' ? current_top + 1 : current_top;
                 break;
 
-            case KEY_UP: 
-                 if (current_top_line > 0) {
-                    current_top_line--;
+            case EV_FAIL:
+                endwin();
+                perror("Error reading file");
+                status = 1;
+                goto cleanup;
+
+            case 'F': // Toggle follow mode
+                if (follow.ifd != -1) {
+                    follow_stop(&follow);
+                } else if (text.gz == NULL && follow_start(&follow, path) == 0) {
+                    current_top = last_page_top(&text, page);
+                } else {
+                    beep();
                 }
                 break;
 
-            case KEY_NPAGE: // Page Down
-                current_top_line += max_win_lines;
-                
-                if (current_top_line + max_win_lines > line_count) {
-                    current_top_line = line_count - max_win_lines;
-                    if (current_top_line < 0) current_top_line = 0;
+            case ' ':
+            case KEY_DOWN:
+                if (current_top < last_page_top(&text, page)) {
+                    current_top = next_line(&text, current_top);
                 }
                 break;
 
+            case KEY_UP:
+                current_top = prev_line(&text, current_top);
+                break;
+
+            case KEY_NPAGE: { // Page Down
+                size_t last = last_page_top(&text, page);
+                for (size_t i = 0; i < page && current_top < last; i++)
+                    current_top = next_line(&text, current_top);
+                break;
+            }
+
             case KEY_PPAGE: // Page Up
-                current_top_line -= max_win_lines;
-                if (current_top_line < 0) {
-                    current_top_line = 0;
-                }
+                for (size_t i = 0; i < page && current_top > 0; i++)
+                    current_top = prev_line(&text, current_top);
+                break;
+
+            case KEY_HOME:
+                current_top = 0;
+                break;
+
+            case KEY_END:
+                current_top = last_page_top(&text, page);
+                stick = !text_final(&text);
                 break;
 
             case KEY_RIGHT: // Scroll right one column
@@ -186,13 +559,15 @@ int main(int argc, char *argv[]) {
     }
 
 cleanup:
-    // --- Deallocate memory and end ncurses mode ---
-    for (int i = 0; i < line_count; i++) {
-        free(lines[i]);
-    }
-    free(lines);
+    // --- Unmap the file and end ncurses mode ---
+    map_guard = NULL;
+    if (searching) search_stop(&search);
+    follow_stop(&follow);
+    free_text(&text);
+    screen_free(&screen);
+    delwin(view);
     delwin(win);
     endwin();
 
-    return 0;
+    return status;
 }
@@ -0,0 +1,134 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nlscan.h"
+
+// Micro-benchmark for the newline kernels used by Show's line indexer.
+// Usage: bench_nlscan [MiB]   (default 256)
+//
+// The input is a synthetic log (lines of 20..200 bytes, fixed seed). Every
+// variant produces the same line-start offsets; the old fgetc() counting
+// loop runs over a temporary copy of the data on disk, as Show used to.
+
+#define REPS 5
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_log(char *buf, size_t size) {
+    unsigned long long seed = 88172645463325252ull;
+    size_t i = 0;
+
+    while (i < size) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        size_t len = 20 + seed % 181;
+        for (size_t j = 0; j < len && i < size; j++, i++)
+            buf[i] = (char)('a' + (i + j) % 26);
+        if (i < size) buf[i++] = '\n';
+    }
+}
+
+static size_t run_memchr(const char *p, size_t n, size_t *out) {
+    const char *q = p, *end = p + n;
+    size_t k = 0;
+
+    while ((q = memchr(q, '\n', (size_t)(end - q))) != NULL) {
+        q++;
+        out[k++] = (size_t)(q - p);
+    }
+    return k;
+}
+
+static size_t run_fgetc(const char *path) {
+    FILE *f = fopen(path, "r");
+    size_t k = 0;
+    int c;
+
+    if (f == NULL) return 0;
+    while ((c = fgetc(f)) != EOF)
+        if (c == '\n') k++;
+    fclose(f);
+    return k;
+}
+
+static void report(const char *name, double best, size_t n, size_t lines, size_t expect) {
+    printf("%-8s %8.3f ms %8.2f GB/s%s\n", name, best * 1e3, n / best / 1e9,
+           lines == expect ? "" : "  (MISMATCH)");
+}
+
+int main(int argc, char *argv[]) {
+    size_t mib = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+    size_t n = mib << 20;
+    char *buf = malloc(n ? n : 1);
+    size_t *out = malloc((n / 2 + 1) * sizeof(*out));
+    struct { const char *name; nl_scan_fn fn; } kernels[] = {
+        { "scalar", nl_scan_scalar },
+#if defined(__x86_64__) || defined(__i386__)
+        { "sse2", nl_scan_sse2 },
+        { "avx2", nl_have_avx2() ? nl_scan_avx2 : NULL },
+#endif
+    };
+    size_t expect, lines = 0;
+    double best, t;
+
+    if (buf == NULL || out == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    fill_log(buf, n);
+    printf("input: %zu MiB synthetic log, dispatch picks %s\n", mib, nl_scan_name());
+
+    expect = run_memchr(buf, n, out);
+    best = 1e9;
+    for (int r = 0; r < REPS; r++) {
+        t = now();
+        lines = run_memchr(buf, n, out);
+        t = now() - t;
+        if (t < best) best = t;
+    }
+    report("memchr", best, n, lines, expect);
+
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        size_t scanned;
+        if (kernels[i].fn == NULL) {
+            printf("%-8s (not supported by this CPU)\n", kernels[i].name);
+            continue;
+        }
+        best = 1e9;
+        for (int r = 0; r < REPS; r++) {
+            t = now();
+            lines = kernels[i].fn(buf, n, 0, out, n / 2 + 1, &scanned);
+            t = now() - t;
+            if (t < best) best = t;
+        }
+        report(kernels[i].name, best, n, lines, expect);
+    }
+
+    char path[] = "/tmp/bench_nlscanXXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fd == -1 ? NULL : fdopen(fd, "w");
+    if (f != NULL && fwrite(buf, 1, n, f) == n && fclose(f) == 0) {
+        best = 1e9;
+        for (int r = 0; r < REPS; r++) {
+            t = now();
+            lines = run_fgetc(path);
+            t = now() - t;
+            if (t < best) best = t;
+        }
+        report("fgetc", best, n, lines, expect);
+    } else {
+        fprintf(stderr, "fgetc baseline skipped: cannot write %s\n", path);
+    }
+    if (fd != -1) unlink(path);
+
+    free(out);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,96 @@
+#define _GNU_SOURCE
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "search.h"
+
+// Throughput of Show's background search on a synthetic log.
+// Usage: bench_search [MiB]   (default 512)
+//
+// Log lines look like "2025-10-17 12:34:56 INFO worker-7 request id=... took
+// 123ms"; one line in 10000 is an ERROR. For each pattern the file is
+// searched from a cold start, and the time to the first published hit is
+// reported next to the total scan time, as the pager sees it.
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_log(FILE *f, size_t size) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN" };
+    unsigned long long seed = 88172645463325252ull;
+    size_t written = 0;
+
+    for (unsigned long id = 0; written < size; id++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        int n = fprintf(f, "2025-10-17 %02lu:%02lu:%02lu %s worker-%llu request id=%lu took %llums\n",
+                        id / 3600 % 24, id / 60 % 60, id % 60,
+                        id % 10000 == 9999 ? "ERROR" : levels[seed % 5],
+                        seed % 32, id, seed % 1000);
+        if (n < 0) return -1;
+        written += (size_t)n;
+    }
+    return fflush(f);
+}
+
+static void run(const char *pattern, int fd, size_t size) {
+    struct search s;
+    char err[128];
+    size_t count = 0, scanned = 0;
+    double start = now(), first = -1;
+
+    if (search_start(&s, pattern, fd, NULL, size, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s: %s\n", pattern, err);
+        return;
+    }
+    while (scanned < size) {
+        struct pollfd p = { .fd = search_fd(&s), .events = POLLIN };
+        poll(&p, 1, -1);
+        search_drain(&s);
+        search_progress(&s, &count, &scanned);
+        if (first < 0 && count > 0) first = now() - start;
+    }
+    double total = now() - start;
+    printf("%-28s %9zu hits  ", pattern, count);
+    if (first < 0)
+        printf("first        - ms  ");
+    else
+        printf("first %8.2f ms  ", first * 1e3);
+    printf("total %8.1f ms  %7.2f GB/s%s\n", total * 1e3, size / total / 1e9,
+           s.failed ? "  (FAILED)" : "");
+    search_stop(&s);
+}
+
+int main(int argc, char *argv[]) {
+    size_t mib = argc > 1 ? strtoul(argv[1], NULL, 10) : 512;
+    const char *patterns[] = {
+        "ERROR",                  // rare literal
+        "worker-(3|17) ",         // alternation, ~6% of lines
+        "id=[0-9]*42 took",       // anchored digits, ~1%
+        "took [0-9]{3}ms$",       // common, end of line
+        "no such thing",          // never matches
+    };
+    char path[] = "/tmp/bench_searchXXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fd == -1 ? NULL : fdopen(fd, "w+");
+
+    if (f == NULL || write_log(f, mib << 20) != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+        if (fd != -1) unlink(path);
+        return 1;
+    }
+    size_t size = (size_t)ftell(f);
+    printf("input: %zu MiB synthetic log (page cache warm after the first pattern)\n", mib);
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+        run(patterns[i], fd, size);
+
+    fclose(f);
+    unlink(path);
+    return 0;
+}
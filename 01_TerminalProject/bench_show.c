@@ -0,0 +1,165 @@
+#define _GNU_SOURCE
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "screen.h"
+#include "text.h"
+
+// Cost of Show's load path and rendering, without a terminal.
+// Usage: bench_show [MiB ...]   (default 1 16 256 1024; 10240 for 10 GB)
+//
+// For each size a synthetic log is written to /tmp and viewed by a fresh
+// process, so the peak RSS is that file's alone. It reports the time to
+// open the file, to index all its lines, and the average cost of a frame
+// after a one-line scroll, a page down, a jump to a random offset and a
+// one-column horizontal scroll. Frames go through ncurses into /dev/null,
+// so everything but the terminal itself is measured. The RSS includes the
+// pages of the mapping that were touched, as top shows it.
+
+#define ROWS 50
+#define COLS 160
+#define STEPS 2000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int write_log(FILE *f, size_t size) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN" };
+    unsigned long long seed = 88172645463325252ull;
+    size_t written = 0;
+
+    for (unsigned long id = 0; written < size; id++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        int n = fprintf(f, "2025-10-17 %02lu:%02lu:%02lu %s worker-%llu request id=%lu took %llums\n",
+                        id / 3600 % 24, id / 60 % 60, id % 60, levels[seed % 5],
+                        seed % 32, id, seed % 1000);
+        if (n < 0) return -1;
+        written += (size_t)n;
+    }
+    return fflush(f);
+}
+
+static void frame(struct screen *s, const struct text *t, size_t top, size_t left) {
+    screen_update(s, t, top, left);
+    wnoutrefresh(s->view);
+    doupdate();
+}
+
+enum { SCROLL, PAGE, JUMP, SIDEWAYS };
+
+// Average seconds per frame over STEPS moves of the given kind.
+static double frames(struct screen *s, const struct text *t, int kind) {
+    size_t top = 0, left = 0, last = last_page_top(t, ROWS);
+    unsigned long long seed = 2463534242ull;
+    double start = now();
+
+    for (int i = 0; i < STEPS; i++) {
+        switch (kind) {
+            case SCROLL:
+                top = top < last ? next_line(t, top) : 0;
+                break;
+            case PAGE:
+                for (int k = 0; k < ROWS && top < last; k++) top = next_line(t, top);
+                if (top >= last) top = 0;
+                break;
+            case JUMP:
+                seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+                top = t->size ? line_start(t, seed % t->size) : 0;
+                break;
+            case SIDEWAYS:
+                left = (i / 40) % 2 ? 40 - i % 40 : i % 40; // back and forth
+                break;
+        }
+        frame(s, t, top, left);
+    }
+    return (now() - start) / STEPS;
+}
+
+static int run(const char *path, size_t mib) {
+    struct text text;
+    struct screen screen;
+    struct rusage ru;
+    double t0 = now();
+
+    if (load_text(&text, path) != 0) {
+        perror(path);
+        free_text(&text);
+        return 1;
+    }
+    double opened = now();
+    while (!index_complete(&text)) {
+        if (index_chunk(&text, INDEX_CHUNK) != 0) {
+            perror("index");
+            free_text(&text);
+            return 1;
+        }
+    }
+    double indexed = now();
+
+    FILE *out = fopen("/dev/null", "w"), *in = fopen("/dev/null", "r");
+    char lines[16], cols[16];
+    snprintf(lines, sizeof(lines), "%d", ROWS);
+    snprintf(cols, sizeof(cols), "%d", COLS);
+    setenv("LINES", lines, 1);
+    setenv("COLUMNS", cols, 1);
+    setlocale(LC_ALL, "");
+    SCREEN *term = out && in ? newterm("xterm", out, in) : NULL;
+    if (term == NULL || screen_init(&screen, newwin(ROWS, COLS, 0, 0)) != 0) {
+        fprintf(stderr, "cannot set up a headless terminal\n");
+        return 1;
+    }
+    double scroll = frames(&screen, &text, SCROLL);
+    double page = frames(&screen, &text, PAGE);
+    double jump = frames(&screen, &text, JUMP);
+    double side = frames(&screen, &text, SIDEWAYS);
+    screen_free(&screen);
+    delwin(screen.view);
+    endwin();
+    delscreen(term);
+
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%6zu MiB %10zu lines  open %7.3f ms  index %8.1f ms (%5.2f GB/s)  rss %7.1f MiB  "
+           "frame: scroll %6.1f  page %6.1f  jump %6.1f  sideways %6.1f us\n",
+           mib, text.count, (opened - t0) * 1e3, (indexed - opened) * 1e3,
+           text.size / (indexed - opened) / 1e9, ru.ru_maxrss / 1024.0,
+           scroll * 1e6, page * 1e6, jump * 1e6, side * 1e6);
+    fflush(stdout); // the child leaves through _exit()
+    free_text(&text);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t defaults[] = { 1, 16, 256, 1024 };
+    int n = argc > 1 ? argc - 1 : (int)(sizeof(defaults) / sizeof(defaults[0]));
+    int status = 0;
+
+    for (int i = 0; i < n; i++) {
+        size_t mib = argc > 1 ? strtoul(argv[i + 1], NULL, 10) : defaults[i];
+        char path[] = "/tmp/bench_showXXXXXX";
+        int fd = mkstemp(path);
+        FILE *f = fd == -1 ? NULL : fdopen(fd, "w");
+
+        if (f == NULL || write_log(f, mib << 20) != 0 || fclose(f) != 0) {
+            fprintf(stderr, "cannot write %s\n", path);
+            if (fd != -1) unlink(path);
+            return 1;
+        }
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) _exit(run(path, mib));
+        int ws;
+        if (pid == -1 || waitpid(pid, &ws, 0) == -1 || !WIFEXITED(ws) || WEXITSTATUS(ws) != 0)
+            status = 1;
+        unlink(path);
+    }
+    return status;
+}
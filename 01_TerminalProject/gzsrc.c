@@ -0,0 +1,362 @@
+#define _GNU_SOURCE
+#include "gzsrc.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#define WINSIZE 32768          // deflate history needed to resume mid-stream
+#define SPAN0 (1u << 20)       // initial output distance between checkpoints
+#define INBUF (64u << 10)
+#define OUTBUF (4u << 20)      // largest piece gz_advance() hands out
+#define PAGE (256u << 10)
+#define NPAGES 16
+
+// A place decompression can restart from: either the start of a gzip
+// member, or a deflate block boundary inside one (zlib's zran technique).
+struct point {
+    off_t in;                  // compressed offset
+    int bits;                  // unused bits of the byte before `in`
+    int member;                // `in` is the start of a gzip member
+    size_t out;                // decompressed offset
+    unsigned char *window;     // history preceding `out` (block points only)
+    size_t wlen;
+};
+
+// A decompressor positioned somewhere in the stream.
+struct stream {
+    z_stream zs;
+    int active;
+    int raw;                   // inflating raw deflate (resumed mid-member)
+    off_t in;                  // next compressed offset to read
+    size_t out;                // decompressed offset of the next byte
+    unsigned char buf[INBUF];
+};
+
+struct page {
+    size_t no;
+    size_t len;
+    char *data;
+    unsigned long used;        // LRU clock, 0 = empty slot
+};
+
+struct gzsrc {
+    int fd;
+    off_t insize;              // compressed size, for progress only
+    struct stream fwd;         // the front-to-back pass
+    unsigned char *obuf;       // its output: WINSIZE of history + new bytes
+    size_t olen;
+    int done;
+
+    struct point *pts;
+    size_t npts;
+    size_t span;
+
+    struct stream rd;          // random access reads
+    struct page pages[NPAGES];
+    unsigned long clock;
+};
+
+static int refill(struct gzsrc *g, struct stream *s) {
+    ssize_t n = pread(g->fd, s->buf, INBUF, s->in);
+    if (n < 0) return -1;
+    s->zs.next_in = s->buf;
+    s->zs.avail_in = (uInt)n;
+    s->in += n;
+    return (int)(n > 0);
+}
+
+// Compressed offset of the next byte inflate would consume.
+static off_t consumed(const struct stream *s) {
+    return s->in - (off_t)s->zs.avail_in;
+}
+
+// After a member ends: is another gzip member next? Leaves the stream
+// ready to parse its header.
+static int next_member(struct gzsrc *g, struct stream *s) {
+    if (s->raw) {
+        // Raw inflate stops before the 8-byte gzip trailer; skip it
+        for (int skip = 8; skip > 0; ) {
+            if (s->zs.avail_in == 0 && refill(g, s) <= 0) return 0;
+            uInt k = s->zs.avail_in < (uInt)skip ? s->zs.avail_in : (uInt)skip;
+            s->zs.next_in += k;
+            s->zs.avail_in -= k;
+            skip -= (int)k;
+        }
+    }
+    while (s->zs.avail_in < 2) {
+        // Keep the byte already buffered while reading more
+        if (s->zs.avail_in == 1) {
+            s->buf[0] = s->zs.next_in[0];
+            ssize_t n = pread(g->fd, s->buf + 1, INBUF - 1, s->in);
+            if (n <= 0) return 0;
+            s->zs.next_in = s->buf;
+            s->zs.avail_in = 1 + (uInt)n;
+            s->in += n;
+        } else if (refill(g, s) <= 0) {
+            return 0;
+        }
+    }
+    if (s->zs.next_in[0] != 0x1f || s->zs.next_in[1] != 0x8b) return 0; // trailing garbage
+    if (inflateReset2(&s->zs, 31) != Z_OK) return 0;
+    s->raw = 0;
+    return 1;
+}
+
+// Keep every other checkpoint once the table is full.
+static void thin_points(struct gzsrc *g) {
+    size_t j = 0;
+    for (size_t i = 0; i < g->npts; i++) {
+        if (i % 2 == 0)
+            g->pts[j++] = g->pts[i];
+        else
+            free(g->pts[i].window);
+    }
+    g->npts = j;
+    g->span *= 2;
+}
+
+static int add_point(struct gzsrc *g, int member, int bits) {
+    struct point *p;
+
+    if (g->npts == GZ_MAX_POINTS) thin_points(g);
+    p = &g->pts[g->npts];
+    memset(p, 0, sizeof(*p));
+    p->in = consumed(&g->fwd);
+    p->bits = bits;
+    p->member = member;
+    p->out = g->fwd.out;
+    if (!member) {
+        p->wlen = g->olen < WINSIZE ? g->olen : WINSIZE;
+        p->window = malloc(p->wlen ? p->wlen : 1);
+        if (p->window == NULL) return -1;
+        memcpy(p->window, g->obuf + g->olen - p->wlen, p->wlen);
+    }
+    g->npts++;
+    return 0;
+}
+
+struct gzsrc *gz_open(int fd) {
+    unsigned char magic[2];
+    struct stat st;
+    struct gzsrc *g;
+
+    if (pread(fd, magic, 2, 0) != 2 || magic[0] != 0x1f || magic[1] != 0x8b) {
+        errno = 0;
+        return NULL;
+    }
+    g = calloc(1, sizeof(*g));
+    if (g == NULL) return NULL;
+    g->fd = fd;
+    g->insize = fstat(fd, &st) == 0 ? st.st_size : 0;
+    g->span = SPAN0;
+    g->obuf = malloc(WINSIZE + OUTBUF);
+    g->pts = malloc(GZ_MAX_POINTS * sizeof(*g->pts));
+    if (g->obuf == NULL || g->pts == NULL || inflateInit2(&g->fwd.zs, 31) != Z_OK) {
+        free(g->obuf);
+        free(g->pts);
+        free(g);
+        errno = ENOMEM;
+        return NULL;
+    }
+    g->fwd.active = 1;
+    add_point(g, 1, 0); // the file start; needs no window
+    return g;
+}
+
+void gz_close(struct gzsrc *g) {
+    if (g == NULL) return;
+    inflateEnd(&g->fwd.zs);
+    if (g->rd.active) inflateEnd(&g->rd.zs);
+    for (size_t i = 0; i < g->npts; i++) free(g->pts[i].window);
+    for (int i = 0; i < NPAGES; i++) free(g->pages[i].data);
+    free(g->pts);
+    free(g->obuf);
+    free(g);
+}
+
+ssize_t gz_advance(struct gzsrc *g, size_t want, const char **out) {
+    struct stream *s = &g->fwd;
+    size_t from;
+
+    if (g->done) return 0;
+    if (want > OUTBUF) want = OUTBUF;
+    // Slide: keep only the history a checkpoint window may need
+    if (g->olen + want > WINSIZE + OUTBUF) {
+        size_t keep = g->olen < WINSIZE ? g->olen : WINSIZE;
+        memmove(g->obuf, g->obuf + g->olen - keep, keep);
+        g->olen = keep;
+    }
+    from = g->olen;
+
+    while (g->olen - from < want) {
+        if (s->zs.avail_in == 0) {
+            int r = refill(g, s);
+            if (r < 0) {
+                g->done = 1;
+                return -1;
+            }
+            if (r == 0) { // truncated file: show what was there
+                g->done = 1;
+                break;
+            }
+        }
+        s->zs.next_out = g->obuf + g->olen;
+        s->zs.avail_out = (uInt)(want - (g->olen - from));
+        // Z_BLOCK stops at every deflate block boundary: checkpoint candidates
+        int ret = inflate(&s->zs, Z_BLOCK);
+        size_t n = (size_t)(s->zs.next_out - (g->obuf + g->olen));
+        g->olen += n;
+        s->out += n;
+
+        if (ret == Z_STREAM_END) {
+            if (!next_member(g, s)) {
+                g->done = 1;
+                break;
+            }
+            if (s->out - g->pts[g->npts - 1].out >= g->span && add_point(g, 1, 0) != 0) {
+                g->done = 1;
+                return -1;
+            }
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            g->done = 1;
+            return g->olen > from ? (ssize_t)(g->olen - from) : -1;
+        } else if ((s->zs.data_type & 128) && !(s->zs.data_type & 64) &&
+                   s->out - g->pts[g->npts - 1].out >= g->span) {
+            if (add_point(g, 0, s->zs.data_type & 7) != 0) {
+                g->done = 1;
+                return -1;
+            }
+        }
+    }
+    *out = (const char *)g->obuf + from;
+    return (ssize_t)(g->olen - from);
+}
+
+size_t gz_size(const struct gzsrc *g) {
+    return g->fwd.out;
+}
+
+int gz_done(const struct gzsrc *g) {
+    return g->done;
+}
+
+int gz_percent(const struct gzsrc *g) {
+    if (g->done || g->insize <= 0) return 100;
+    return (int)(consumed(&g->fwd) * 100 / g->insize);
+}
+
+// Position the random-access stream at checkpoint `p`.
+static int seek_point(struct gzsrc *g, const struct point *p) {
+    struct stream *s = &g->rd;
+
+    if (s->active) inflateEnd(&s->zs);
+    memset(&s->zs, 0, sizeof(s->zs));
+    s->active = 0;
+    s->out = p->out;
+    if (p->member) {
+        if (inflateInit2(&s->zs, 31) != Z_OK) return -1;
+        s->raw = 0;
+        s->in = p->in;
+    } else {
+        if (inflateInit2(&s->zs, -15) != Z_OK) return -1;
+        s->raw = 1;
+        s->in = p->in - (p->bits ? 1 : 0);
+        if (p->bits) {
+            unsigned char c;
+            if (pread(g->fd, &c, 1, s->in) != 1) {
+                inflateEnd(&s->zs);
+                return -1;
+            }
+            s->in++;
+            inflatePrime(&s->zs, p->bits, c >> (8 - p->bits));
+        }
+        inflateSetDictionary(&s->zs, p->window, (uInt)p->wlen);
+    }
+    s->active = 1;
+    return 0;
+}
+
+// Decompress the next `n` bytes of the random-access stream into `buf`.
+static size_t read_stream(struct gzsrc *g, char *buf, size_t n) {
+    struct stream *s = &g->rd;
+    size_t got = 0;
+
+    while (got < n) {
+        if (s->zs.avail_in == 0 && refill(g, s) <= 0) break;
+        s->zs.next_out = (unsigned char *)buf + got;
+        s->zs.avail_out = (uInt)(n - got);
+        int ret = inflate(&s->zs, Z_NO_FLUSH);
+        size_t k = (size_t)(s->zs.next_out - ((unsigned char *)buf + got));
+        got += k;
+        s->out += k;
+        if (ret == Z_STREAM_END) {
+            if (!next_member(g, s)) break;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            break;
+        }
+    }
+    return got;
+}
+
+static int load_page(struct gzsrc *g, struct page *pg, size_t no) {
+    size_t start = no * PAGE;
+    size_t len = gz_size(g) - start < PAGE ? gz_size(g) - start : PAGE;
+    size_t lo = 0, hi = g->npts;
+
+    if (pg->data == NULL && (pg->data = malloc(PAGE)) == NULL) return -1;
+
+    // Continue the previous read when it stopped within one span before
+    // `start`; otherwise restart from the last checkpoint at or before it.
+    while (lo + 1 < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (g->pts[mid].out <= start) lo = mid; else hi = mid;
+    }
+    if (!g->rd.active || g->rd.out > start || g->rd.out < g->pts[lo].out) {
+        if (seek_point(g, &g->pts[lo]) != 0) return -1;
+    }
+    while (g->rd.out < start) {
+        size_t skip = start - g->rd.out < PAGE ? start - g->rd.out : PAGE;
+        if (read_stream(g, pg->data, skip) != skip) break;
+    }
+
+    size_t got = g->rd.out == start ? read_stream(g, pg->data, len) : 0;
+    if (got < len) {
+        // The file changed or became unreadable since the first pass
+        memset(pg->data + got, '?', len - got);
+        g->rd.active = 0;
+        inflateEnd(&g->rd.zs);
+    }
+    pg->no = no;
+    pg->len = len;
+    return 0;
+}
+
+const char *gz_page(struct gzsrc *g, size_t off, size_t *start, size_t *end) {
+    size_t no = off / PAGE;
+    struct page *pg = NULL, *victim = &g->pages[0];
+
+    for (int i = 0; i < NPAGES; i++) {
+        struct page *p = &g->pages[i];
+        if (p->used != 0 && p->no == no) {
+            pg = p;
+            break;
+        }
+        if (p->used < victim->used) victim = p;
+    }
+    // A page cut short by the end of the data decoded so far may have grown
+    if (pg == NULL || off >= no * PAGE + pg->len) {
+        if (pg == NULL) pg = victim;
+        if (load_page(g, pg, no) != 0) {
+            pg->used = 0;
+            return NULL;
+        }
+    }
+    pg->used = ++g->clock;
+    *start = no * PAGE;
+    *end = *start + pg->len;
+    return pg->data;
+}
@@ -0,0 +1,40 @@
+#ifndef GZSRC_H
+#define GZSRC_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Seekable view of a gzip file.
+//
+// The file is decompressed once, front to back, by gz_advance(); on the way
+// it records restart checkpoints (deflate block boundary + the 32 KiB of
+// history needed to resume there). Random reads go through gz_page(), which
+// decompresses a single page starting from the nearest checkpoint, or simply
+// continues when the previous read ended just before it.
+//
+// Memory is bounded regardless of the decompressed size: at most
+// GZ_MAX_POINTS checkpoints are kept (the spacing doubles whenever the
+// limit is reached) and only a small LRU of decompressed pages is cached.
+struct gzsrc;
+
+#define GZ_MAX_POINTS 512
+
+// Returns NULL with errno == 0 when `fd` does not start with a gzip header.
+struct gzsrc *gz_open(int fd);
+void gz_close(struct gzsrc *g);
+
+// Decompress up to `want` more bytes. *out points at the new bytes, valid
+// until the next call. Returns the count, 0 at the end, -1 on a read or
+// data error (the data before the error stays readable).
+ssize_t gz_advance(struct gzsrc *g, size_t want, const char **out);
+// Bytes decompressed by gz_advance() so far.
+size_t gz_size(const struct gzsrc *g);
+int gz_done(const struct gzsrc *g);
+// Share of the compressed input consumed by gz_advance().
+int gz_percent(const struct gzsrc *g);
+
+// The cached page holding offset `off` (< gz_size()). The page covers
+// [*start, *end); the returned pointer corresponds to *start.
+const char *gz_page(struct gzsrc *g, size_t off, size_t *start, size_t *end);
+
+#endif
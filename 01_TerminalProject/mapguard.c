@@ -0,0 +1,22 @@
+#define _GNU_SOURCE
+#include "mapguard.h"
+
+#include <signal.h>
+#include <string.h>
+
+__thread sigjmp_buf *map_guard;
+
+static void on_sigbus(int sig) {
+    if (map_guard != NULL) siglongjmp(*map_guard, 1);
+    // Not a guarded read: the faulting access is retried and is fatal
+    signal(sig, SIG_DFL);
+}
+
+int map_guard_init(void) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigbus;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGBUS, &sa, NULL);
+}
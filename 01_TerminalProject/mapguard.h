@@ -0,0 +1,24 @@
+#ifndef MAPGUARD_H
+#define MAPGUARD_H
+
+#include <setjmp.h>
+
+// Reads of a mapped file that shrank under the mapping.
+//
+// Touching a page past the new end of a truncated file raises SIGBUS in
+// the thread that touched it. A thread about to read such a mapping points
+// map_guard at a sigjmp_buf set by sigsetjmp(); the fault then returns
+// there with 1 instead of killing the process, and the reader can remap
+// what is left of the file. With map_guard NULL a SIGBUS is fatal as usual.
+//
+//     sigjmp_buf env;
+//     if (sigsetjmp(env, 1) != 0) { /* shrank: remap, start over */ }
+//     map_guard = &env;
+//     ... read the mapping ...
+//     map_guard = NULL;
+extern __thread sigjmp_buf *map_guard;
+
+// Install the SIGBUS handler. Call once, before any thread is started.
+int map_guard_init(void);
+
+#endif
@@ -0,0 +1,107 @@
+#include "nlscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Emit the newlines of p[i, n) one byte at a time, honouring `max`.
+static size_t scan_tail(const char *p, size_t i, size_t n, size_t base,
+                        size_t *out, size_t k, size_t max, size_t *scanned) {
+    for (; i < n; i++) {
+        if (p[i] == '\n') {
+            if (k == max) break;
+            out[k++] = base + i + 1;
+        }
+    }
+    *scanned = i;
+    return k;
+}
+
+size_t nl_scan_scalar(const char *p, size_t n, size_t base,
+                      size_t *out, size_t max, size_t *scanned) {
+    return scan_tail(p, 0, n, base, out, 0, max, scanned);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+size_t nl_scan_sse2(const char *p, size_t n, size_t base,
+                    size_t *out, size_t max, size_t *scanned) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t i = 0, k = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        if (m == 0) continue;
+        if (max - k < (size_t)__builtin_popcount(m)) break;
+        do {
+            out[k++] = base + i + (size_t)__builtin_ctz(m) + 1;
+            m &= m - 1;
+        } while (m);
+    }
+    return scan_tail(p, i, n, base, out, k, max, scanned);
+}
+
+// Two 32-byte lanes per step: newline-free 64-byte blocks, the common case
+// in log files, cost two compares and one test.
+__attribute__((target("avx2")))
+size_t nl_scan_avx2(const char *p, size_t n, size_t base,
+                    size_t *out, size_t max, size_t *scanned) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t i = 0, k = 0;
+
+    for (; i + 64 <= n; i += 64) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i)), nl);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + i + 32)), nl);
+        if (_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) continue;
+
+        unsigned long long m = (unsigned)_mm256_movemask_epi8(a)
+                             | (unsigned long long)(unsigned)_mm256_movemask_epi8(b) << 32;
+        if (max - k < (size_t)__builtin_popcountll(m)) break;
+        do {
+            out[k++] = base + i + (size_t)__builtin_ctzll(m) + 1;
+            m &= m - 1;
+        } while (m);
+    }
+    return scan_tail(p, i, n, base, out, k, max, scanned);
+}
+
+int nl_have_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+static nl_scan_fn chosen;
+static const char *chosen_name;
+
+static void choose(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (nl_have_avx2()) {
+        chosen = nl_scan_avx2;
+        chosen_name = "avx2";
+        return;
+    }
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        chosen = nl_scan_sse2;
+        chosen_name = "sse2";
+        return;
+    }
+#endif
+    chosen = nl_scan_scalar;
+    chosen_name = "scalar";
+}
+
+size_t nl_scan(const char *p, size_t n, size_t base,
+               size_t *out, size_t max, size_t *scanned) {
+    if (chosen == NULL) choose();
+    return chosen(p, n, base, out, max, scanned);
+}
+
+const char *nl_scan_name(void) {
+    if (chosen == NULL) choose();
+    return chosen_name;
+}
@@ -0,0 +1,32 @@
+#ifndef NLSCAN_H
+#define NLSCAN_H
+
+#include <stddef.h>
+
+// Newline scanning kernels used by the line indexer.
+//
+// Each kernel looks for '\n' in p[0, n) and stores, for every newline at
+// p[i], the offset base + i + 1 (the start of the following line) into
+// out[]. At most `max` offsets are stored; *scanned receives the number
+// of bytes fully examined, so a caller that ran out of room can grow
+// out[] and resume at p + *scanned. The return value is the number of
+// offsets stored.
+typedef size_t (*nl_scan_fn)(const char *p, size_t n, size_t base,
+                             size_t *out, size_t max, size_t *scanned);
+
+size_t nl_scan_scalar(const char *p, size_t n, size_t base,
+                      size_t *out, size_t max, size_t *scanned);
+#if defined(__x86_64__) || defined(__i386__)
+size_t nl_scan_sse2(const char *p, size_t n, size_t base,
+                    size_t *out, size_t max, size_t *scanned);
+size_t nl_scan_avx2(const char *p, size_t n, size_t base,
+                    size_t *out, size_t max, size_t *scanned);
+int nl_have_avx2(void);
+#endif
+
+// Best kernel for the running CPU, picked on first use.
+size_t nl_scan(const char *p, size_t n, size_t base,
+               size_t *out, size_t max, size_t *scanned);
+const char *nl_scan_name(void);
+
+#endif
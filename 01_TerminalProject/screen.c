@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include "screen.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TAB_STOP 8
+
+struct glyph {
+    size_t len;       // bytes taken
+    int width;        // columns taken
+    int n;            // characters in wc[]
+    wchar_t wc[TAB_STOP];
+};
+
+// Decode the character at `at` (< lim), which starts in column `col`.
+static void decode(const struct text *t, size_t at, size_t lim, size_t col, struct glyph *g) {
+    size_t start, end;
+    const char *p = text_piece(t, at, &start, &end) + (at - start);
+    unsigned char c = (unsigned char)*p;
+
+    g->len = 1;
+    g->n = 1;
+    g->width = 1;
+    if (c >= 0x20 && c < 0x7f) {
+        g->wc[0] = c;
+    } else if (c == '\t') {
+        g->width = g->n = TAB_STOP - (int)(col % TAB_STOP);
+        for (int i = 0; i < g->n; i++) g->wc[i] = L' ';
+    } else if (c < 0x80) {
+        g->width = g->n = 2;
+        g->wc[0] = L'^';
+        g->wc[1] = c ^ 0x40;
+    } else {
+        char tmp[MB_LEN_MAX];
+        size_t avail = lim - at < MB_LEN_MAX ? lim - at : MB_LEN_MAX;
+        mbstate_t st;
+        wchar_t wc;
+        int w;
+
+        if (avail > end - at) { // the character straddles two gzip pages
+            for (size_t i = 0; i < avail; i++) tmp[i] = text_byte(t, at + i);
+            p = tmp;
+        }
+        memset(&st, 0, sizeof(st));
+        size_t r = mbrtowc(&wc, p, avail, &st);
+        if (r == 0 || r > avail || (w = wcwidth(wc)) < 0) {
+            g->wc[0] = L'?';
+        } else {
+            g->len = r;
+            g->width = w;
+            g->wc[0] = wc;
+        }
+    }
+}
+
+#define NO_LINE ((size_t)-1)  // row is past the end of the file
+#define DAMAGED ((size_t)-2)  // row contents unknown, must be painted
+
+int screen_init(struct screen *s, WINDOW *view) {
+    memset(s, 0, sizeof(*s));
+    if (view == NULL) return -1;
+    s->view = view;
+    s->rows = getmaxy(view);
+    s->cols = getmaxx(view);
+    if (s->rows <= 0 || s->cols <= 0) return -1;
+    s->buf = malloc(4 * (size_t)s->rows * sizeof(size_t));
+    // Combining characters take no column, so leave room for some
+    s->linecap = 2 * (size_t)s->cols + TAB_STOP;
+    s->line = malloc(s->linecap * sizeof(wchar_t));
+    if (s->buf == NULL || s->line == NULL) return -1;
+    s->off = s->buf;
+    s->end = s->off + s->rows;
+    s->noff = s->end + s->rows;
+    s->nend = s->noff + s->rows;
+    for (int i = 0; i < s->rows; i++) s->off[i] = DAMAGED;
+    for (int i = 0; i < WMAP_SLOTS; i++) s->maps[i].off = NO_LINE;
+    s->left = 0;
+    return 0;
+}
+
+void screen_free(struct screen *s) {
+    for (int i = 0; i < WMAP_SLOTS; i++) free(s->maps[i].marks);
+    free(s->line);
+    free(s->buf);
+}
+
+void screen_damage(struct screen *s) {
+    for (int i = 0; i < s->rows; i++) s->off[i] = DAMAGED;
+}
+
+void screen_reset(struct screen *s) {
+    screen_damage(s);
+    for (int i = 0; i < WMAP_SLOTS; i++) s->maps[i].off = NO_LINE;
+}
+
+
+// The latest mark at or before column `left` of the line [off, end), whose
+// text is [off, cend), extending its map as needed. Returns 0 when out of
+// memory.
+static int wmap_seek(struct screen *s, const struct text *t, size_t off, size_t end,
+                     size_t cend, size_t left, struct mark *out) {
+    struct wmap *m = NULL, *victim = &s->maps[0];
+    struct glyph g;
+
+    for (int i = 0; i < WMAP_SLOTS && m == NULL; i++) {
+        if (s->maps[i].off == off) m = &s->maps[i];
+        else if (s->maps[i].used < victim->used) victim = &s->maps[i];
+    }
+    if (m == NULL) {
+        m = victim;
+        m->off = off;
+        m->n = 0;
+        m->walk.byte = off;
+        m->walk.col = 0;
+    }
+    // Only a finished line keeps its end: a growing last line moves it
+    m->end = cend < end ? end : 0;
+    m->used = ++s->clock;
+
+    while (m->n <= left / WMAP_STEP && m->walk.byte < cend) {
+        if (m->walk.col >= m->n * WMAP_STEP) {
+            if (m->n == m->cap) {
+                size_t ncap = m->cap ? m->cap * 2 : 64;
+                struct mark *nm = realloc(m->marks, ncap * sizeof(*nm));
+                if (nm == NULL) {
+                    m->off = NO_LINE;
+                    return 0;
+                }
+                m->marks = nm;
+                m->cap = ncap;
+            }
+            m->marks[m->n++] = m->walk;
+        }
+        decode(t, m->walk.byte, cend, m->walk.col, &g);
+        m->walk.byte += g.len;
+        m->walk.col += (size_t)g.width;
+    }
+    if (m->n == 0) return 0;
+
+    size_t k = left / WMAP_STEP < m->n ? left / WMAP_STEP : m->n - 1;
+    if (m->marks[k].col > left && k > 0) k--; // a tab or wide char crossed the boundary
+    *out = m->marks[k];
+    return 1;
+}
+
+static void paint_row(struct screen *s, const struct text *t, int row,
+                      size_t off, size_t end, size_t left) {
+    wmove(s->view, row, 0);
+    wclrtoeol(s->view);
+    if (off == NO_LINE) return;
+
+    // Lines are not NUL-terminated: decode a bounded slice of the text,
+    // starting from the nearest column mark when scrolled far right
+    size_t cend = off + content_len(t, off, end);
+    struct mark at = { off, 0 };
+    if (left >= WMAP_STEP && cend - off > WMAP_MIN && !wmap_seek(s, t, off, end, cend, left, &at)) {
+        at.byte = off;
+        at.col = 0;
+    }
+
+    size_t n = 0;
+    int used = 0;
+    struct glyph g;
+    while (at.byte < cend && used < s->cols) {
+        decode(t, at.byte, cend, at.col, &g);
+        if (at.col >= left) {
+            if (used + g.width > s->cols) break; // a wide character cut by the edge
+            for (int i = 0; i < g.n && n < s->linecap; i++) s->line[n++] = g.wc[i];
+            used += g.width;
+        } else if (at.col + (size_t)g.width > left) {
+            // Cut by the left edge: blank out its visible part
+            for (size_t c = left; c < at.col + (size_t)g.width && used < s->cols; c++, used++)
+                s->line[n++] = L' ';
+        }
+        at.byte += g.len;
+        at.col += (size_t)g.width;
+    }
+    waddnwstr(s->view, s->line, (int)n);
+}
+
+// Shift the remembered rows to match a wscrl(view, k) already issued.
+static void screen_scrolled(struct screen *s, int k) {
+    int n = s->rows, a = k > 0 ? k : -k;
+
+    if (k > 0) {
+        memmove(s->off, s->off + a, (n - a) * sizeof(size_t));
+        memmove(s->end, s->end + a, (n - a) * sizeof(size_t));
+        for (int i = n - a; i < n; i++) s->off[i] = DAMAGED;
+    } else {
+        memmove(s->off + a, s->off, (n - a) * sizeof(size_t));
+        memmove(s->end + a, s->end, (n - a) * sizeof(size_t));
+        for (int i = 0; i < a; i++) s->off[i] = DAMAGED;
+    }
+}
+
+// End of the line at `off`: from its column map when it has one, so a long
+// line the index has not reached yet is not scanned again every frame.
+static size_t row_end(const struct screen *s, const struct text *t, size_t off) {
+    for (int i = 0; i < WMAP_SLOTS; i++)
+        if (s->maps[i].off == off && s->maps[i].end != 0) return s->maps[i].end;
+    return line_end(t, off);
+}
+
+void screen_update(struct screen *s, const struct text *t, size_t top, size_t left) {
+    int n = s->rows, shift = 0;
+    size_t off = top;
+
+    for (int i = 0; i < n; i++) {
+        if (off < t->size) {
+            s->noff[i] = off;
+            s->nend[i] = row_end(s, t, off);
+            off = s->nend[i];
+        } else {
+            s->noff[i] = NO_LINE;
+            s->nend[i] = 0;
+        }
+    }
+
+    if (s->noff[0] != NO_LINE && s->off[0] != NO_LINE && s->off[0] != DAMAGED) {
+        for (int k = 1; k < n && !shift; k++) {
+            if (s->off[k] == s->noff[0]) shift = k;
+            else if (s->noff[k] == s->off[0]) shift = -k;
+        }
+    }
+    if (shift != 0) {
+        scrollok(s->view, TRUE);
+        wscrl(s->view, shift);
+        scrollok(s->view, FALSE);
+        screen_scrolled(s, shift);
+    }
+
+    if (left != s->left) {
+        screen_damage(s);
+        s->left = left;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (s->off[i] != s->noff[i] || s->end[i] != s->nend[i])
+            paint_row(s, t, i, s->noff[i], s->nend[i], left);
+    }
+
+    size_t *tmp = s->off; s->off = s->noff; s->noff = tmp;
+    tmp = s->end; s->end = s->nend; s->nend = tmp;
+}
@@ -0,0 +1,68 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#define NCURSES_WIDECHAR 1
+#include <ncurses.h>
+#include <stddef.h>
+#include <wchar.h>
+
+#include "text.h"
+
+// The text view of the pager.
+//
+// The view remembers which line each row shows, so a frame only repaints
+// rows whose line changed. Vertical moves by less than a page become a
+// wscrl() plus the newly exposed rows (sent as a terminal scroll).
+//
+// Lines are decoded in the current locale (UTF-8 in practice) and laid out
+// in display columns: wide characters take two, tabs reach the next stop,
+// control characters are shown as ^X and undecodable bytes as '?'.
+
+// Column map of a long line: where every WMAP_STEP-th column starts, so a
+// row scrolled far to the right is painted without decoding the line from
+// its start. Built only as far as the view has been scrolled, and kept for
+// a few lines so scrolling back and forth reuses it. It also remembers where
+// the line ends, which the index may not know yet.
+#define WMAP_STEP 256
+#define WMAP_MIN 4096  // shorter lines are just decoded from the start
+#define WMAP_SLOTS 64
+
+struct mark {
+    size_t byte, col; // a character starts at `byte`, in column `col`
+};
+
+struct wmap {
+    size_t off;       // the line, NO_LINE for a free slot
+    struct mark *marks; // marks[k]: first character at column >= k * WMAP_STEP
+    size_t n, cap;
+    struct mark walk; // where building stopped
+    size_t end;       // past the line's newline, 0 if it has none (yet)
+    unsigned long used;
+};
+
+struct screen {
+    WINDOW *view;
+    int rows, cols;
+    size_t *off, *end;   // shown line per row: [off, end), end past the newline
+    size_t *noff, *nend; // layout of the frame being built
+    size_t left;         // first shown column
+    size_t *buf;         // backing store of the four arrays above
+    wchar_t *line;       // characters of the row being painted
+    size_t linecap;
+    struct wmap maps[WMAP_SLOTS];
+    unsigned long clock;
+};
+
+// Take over `view`, whose whole area shows text. On failure screen_free()
+// must still be called.
+int screen_init(struct screen *s, WINDOW *view);
+void screen_free(struct screen *s);
+// Repaint every row on the next update.
+void screen_damage(struct screen *s);
+// The text was replaced: forget the rows and the column maps.
+void screen_reset(struct screen *s);
+// Bring the view to `top`/`left`, painting as little as possible. Only the
+// window is updated; refreshing the terminal is left to the caller.
+void screen_update(struct screen *s, const struct text *t, size_t top, size_t left);
+
+#endif
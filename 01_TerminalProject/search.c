@@ -0,0 +1,412 @@
+#define _GNU_SOURCE
+#include "search.h"
+
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "mapguard.h"
+
+// Bytes handed to one regexec() sweep. Hits are published, and
+// cancellation noticed, once per chunk.
+#define SEARCH_CHUNK (1u << 20)
+
+static void wakeup(struct search *s) {
+    if (write(s->notify[1], "", 1) == -1) {
+        // The pipe is full: a wakeup is already pending
+    }
+}
+
+struct hitbuf {
+    size_t *v;
+    size_t n, cap;
+};
+
+static int hitbuf_push(struct hitbuf *b, size_t off) {
+    if (b->n == b->cap) {
+        size_t ncap = b->cap ? b->cap * 2 : 256;
+        size_t *nv = realloc(b->v, ncap * sizeof(*nv));
+        if (nv == NULL) return -1;
+        b->v = nv;
+        b->cap = ncap;
+    }
+    b->v[b->n++] = off;
+    return 0;
+}
+
+// Find the matching lines of base[from, to), which starts at a line start.
+// One regexec() call covers the whole rest of the chunk: REG_NEWLINE keeps
+// matches inside a line, and after a hit the scan resumes at the next line.
+static int scan_chunk(struct search *s, const char *base, size_t from, size_t to,
+                      struct hitbuf *out) {
+    size_t pos = from;
+
+    while (pos < to) {
+        regmatch_t m = { .rm_so = (regoff_t)pos, .rm_eo = (regoff_t)to };
+        if (regexec(&s->re, base, 1, &m, REG_STARTEND) != 0) break;
+
+        size_t at = (size_t)m.rm_so;
+        const char *nl = memrchr(base + pos, '\n', at - pos);
+        if (hitbuf_push(out, nl ? (size_t)(nl - base) + 1 : pos) != 0) return -1;
+
+        nl = memchr(base + at, '\n', to - at);
+        if (nl == NULL) break;
+        pos = (size_t)(nl - base) + 1;
+    }
+    return 0;
+}
+
+// Append a chunk's hits. The last line of a growing file may be scanned
+// twice (see worker()), so a hit equal to the previous one is dropped.
+// Returns 1 when the search was cancelled, -1 when out of memory.
+static int publish(struct search *s, const struct hitbuf *b, size_t scanned) {
+    int rc = 0;
+
+    pthread_mutex_lock(&s->lock);
+    for (size_t i = 0; i < b->n; i++) {
+        if (s->count > 0 && s->hits[s->count - 1] >= b->v[i]) continue;
+        if (s->count == s->cap) {
+            size_t ncap = s->cap ? s->cap * 2 : 256;
+            size_t *nh = realloc(s->hits, ncap * sizeof(*nh));
+            if (nh == NULL) {
+                rc = -1;
+                break;
+            }
+            s->hits = nh;
+            s->cap = ncap;
+        }
+        s->hits[s->count++] = b->v[i];
+    }
+    s->scanned = scanned;
+    if (rc == 0 && s->cancel) rc = 1;
+    pthread_mutex_unlock(&s->lock);
+
+    wakeup(s);
+    return rc;
+}
+
+static int is_gzip(int fd) {
+    unsigned char magic[2];
+    return pread(fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// A gzip file has no mapping to search: stream it through zlib instead,
+// keeping the unfinished last line of each read for the next one. Returns
+// like publish(); *total is the decompressed size once the end is reached.
+static int scan_gzip(struct search *s, int file, struct hitbuf *hits, size_t *total) {
+    size_t cap = 2 * SEARCH_CHUNK, carry = 0, base = 0;
+    char *buf = malloc(cap);
+    int fd = dup(file);
+    gzFile z = NULL;
+    int stop = 0;
+
+    // gzdopen() starts at the current offset, which the dup shares
+    if (fd != -1 && lseek(fd, 0, SEEK_SET) == 0) z = gzdopen(fd, "rb");
+    if (z == NULL || buf == NULL) {
+        if (z != NULL) gzclose(z); else if (fd != -1) close(fd);
+        free(buf);
+        return -1;
+    }
+    while (stop == 0) {
+        if (carry == cap) { // one line longer than the buffer
+            char *nb = realloc(buf, cap * 2);
+            if (nb == NULL) {
+                stop = -1;
+                break;
+            }
+            buf = nb;
+            cap *= 2;
+        }
+        size_t room = cap - carry > SEARCH_CHUNK ? SEARCH_CHUNK : cap - carry;
+        int n = gzread(z, buf + carry, (unsigned)room);
+        if (n < 0) {
+            stop = -1;
+            break;
+        }
+        size_t len = carry + (size_t)n, upto = len;
+        if (n > 0) {
+            const char *nl = memrchr(buf, '\n', len);
+            if (nl == NULL) {
+                carry = len;
+                continue;
+            }
+            upto = (size_t)(nl - buf) + 1;
+        }
+
+        hits->n = 0;
+        if (scan_chunk(s, buf, 0, upto, hits) != 0) {
+            stop = -1;
+            break;
+        }
+        for (size_t i = 0; i < hits->n; i++) hits->v[i] += base;
+        base += upto;
+        stop = publish(s, hits, base);
+        if (n == 0) break;
+        carry = len - upto;
+        memmove(buf, buf + upto, carry);
+    }
+    gzclose(z);
+    free(buf);
+    *total = base;
+    return stop;
+}
+
+// Copy the lines of a mapping starting in [from, *to) out of it, moving
+// *to past the end of the last one. regexec() then runs on the copy: a
+// fault inside it, when the file is truncated under the mapping, would
+// leave the pattern's lock held. Returns -1 when the copy faulted (see
+// mapguard.h) or when out of memory.
+static int copy_lines(const char *base, size_t size, size_t from, size_t *to,
+                      char **copy, size_t *cap) {
+    sigjmp_buf bus;
+
+    if (sigsetjmp(bus, 1) != 0) {
+        map_guard = NULL;
+        return -1;
+    }
+    map_guard = &bus;
+    if (*to < size) {
+        const char *nl = memchr(base + *to, '\n', size - *to);
+        *to = nl ? (size_t)(nl - base) + 1 : size;
+    }
+    if (*to - from > *cap) {
+        char *nc = realloc(*copy, *to - from);
+        if (nc == NULL) {
+            map_guard = NULL;
+            return -1;
+        }
+        *copy = nc;
+        *cap = *to - from;
+    }
+    memcpy(*copy, base + from, *to - from);
+    map_guard = NULL;
+    return 0;
+}
+
+static void *worker(void *arg) {
+    struct search *s = arg;
+    struct hitbuf buf = { 0 };
+    void *map = NULL;
+    size_t mapped = 0;
+    char *copy = NULL;
+    size_t copied = 0;
+    int stop = 0;
+
+    // search_grow() may move `data` and `size` under us: work from copies
+    pthread_mutex_lock(&s->lock);
+    size_t pos = s->scanned;
+    size_t size = s->size;
+    const char *data = s->data;
+    int fd = s->fd;
+    pthread_mutex_unlock(&s->lock);
+
+    if (fd != -1 && is_gzip(fd)) {
+        stop = scan_gzip(s, fd, &buf, &size);
+        pthread_mutex_lock(&s->lock);
+        if (stop == 0) s->size = size;
+        s->failed = stop < 0;
+        s->running = 0;
+        pthread_mutex_unlock(&s->lock);
+        wakeup(s);
+        free(buf.v);
+        return NULL;
+    }
+
+    for (;;) {
+        const char *base = data;
+
+        if (fd != -1) {
+            if (map != NULL) munmap(map, mapped);
+            map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                map = NULL;
+                stop = -1;
+            } else {
+                mapped = size;
+                base = map;
+                madvise(map, size, MADV_SEQUENTIAL);
+            }
+        }
+
+        while (pos < size && stop == 0) {
+            size_t to = size - pos > SEARCH_CHUNK ? pos + SEARCH_CHUNK : size;
+            const char *p = base + pos; // the lines [pos, to)
+            if (map != NULL) {
+                // A truncated file fails the search; the pager restarts it
+                if (copy_lines(base, size, pos, &to, &copy, &copied) != 0) {
+                    stop = -1;
+                    break;
+                }
+                p = copy;
+            } else if (to < size) {
+                const char *nl = memchr(base + to, '\n', size - to);
+                to = nl ? (size_t)(nl - base) + 1 : size;
+            }
+
+            buf.n = 0;
+            if (scan_chunk(s, p, 0, to - pos, &buf) != 0) {
+                stop = -1;
+                break;
+            }
+            for (size_t i = 0; i < buf.n; i++) buf.v[i] += pos;
+
+            // An unterminated last line may still grow: resume at its start
+            size_t next = to;
+            if (to == size && p[to - pos - 1] != '\n') {
+                const char *nl = memrchr(p, '\n', to - pos);
+                next = nl ? pos + (size_t)(nl - p) + 1 : pos;
+            }
+            stop = publish(s, &buf, next);
+            if (next == pos) break;
+            pos = next;
+        }
+
+        // Done, unless search_grow() raised the size meanwhile
+        pthread_mutex_lock(&s->lock);
+        if (stop != 0 || s->size <= size) {
+            s->failed = stop < 0;
+            s->running = 0;
+            pthread_mutex_unlock(&s->lock);
+            break;
+        }
+        size = s->size;
+        data = s->data;
+        fd = s->fd;
+        pthread_mutex_unlock(&s->lock);
+    }
+    wakeup(s);
+
+    if (map != NULL) munmap(map, mapped);
+    free(copy);
+    free(buf.v);
+    return NULL;
+}
+
+static int spawn(struct search *s) {
+    s->cancel = 0;
+    s->running = 1;
+    if (pthread_create(&s->thread, NULL, worker, s) != 0) {
+        s->running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Wait for the worker to exit; it may be cancelled or already finished.
+static void reap(struct search *s, int cancel) {
+    pthread_mutex_lock(&s->lock);
+    if (cancel) s->cancel = 1;
+    pthread_mutex_unlock(&s->lock);
+    if (s->thread_valid) {
+        pthread_join(s->thread, NULL);
+        s->thread_valid = 0;
+    }
+}
+
+int search_start(struct search *s, const char *pattern, int fd,
+                 const char *data, size_t size, char *err, size_t errlen) {
+    int rc;
+
+    memset(s, 0, sizeof(*s));
+    rc = regcomp(&s->re, pattern, REG_EXTENDED | REG_NEWLINE);
+    if (rc != 0) {
+        regerror(rc, &s->re, err, errlen);
+        return -1;
+    }
+    if (pipe2(s->notify, O_NONBLOCK | O_CLOEXEC) == -1) {
+        regfree(&s->re);
+        snprintf(err, errlen, "cannot create pipe");
+        return -1;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    s->fd = fd == -1 ? -1 : dup(fd);
+    s->data = data;
+    s->size = size;
+    if (size > 0) {
+        if (spawn(s) == 0) s->thread_valid = 1; else s->failed = 1;
+    }
+    return 0;
+}
+
+void search_stop(struct search *s) {
+    reap(s, 1);
+    if (s->fd != -1) close(s->fd);
+    regfree(&s->re);
+    close(s->notify[0]);
+    close(s->notify[1]);
+    pthread_mutex_destroy(&s->lock);
+    free(s->hits);
+}
+
+int search_grow(struct search *s, const char *data, size_t size) {
+    pthread_mutex_lock(&s->lock);
+    int running = s->running;
+    s->data = data;
+    if (size > s->size) s->size = size;
+    pthread_mutex_unlock(&s->lock);
+    if (running) return 0; // the worker notices the new size itself
+
+    reap(s, 0);
+    if (spawn(s) != 0) return -1;
+    s->thread_valid = 1;
+    return 0;
+}
+
+int search_restart(struct search *s, int fd, const char *data, size_t size) {
+    reap(s, 1);
+    if (s->fd != -1) close(s->fd);
+    s->fd = fd == -1 ? -1 : dup(fd);
+    s->data = data;
+    s->size = size;
+    s->count = 0;
+    s->scanned = 0;
+    s->failed = 0;
+    if (size == 0) return 0;
+    if (spawn(s) != 0) return -1;
+    s->thread_valid = 1;
+    return 0;
+}
+
+int search_find(struct search *s, size_t from, int dir, size_t *hit) {
+    size_t lo = 0, hi;
+    int found = 0;
+
+    pthread_mutex_lock(&s->lock);
+    hi = s->count;
+    // First hit >= from
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s->hits[mid] < from) lo = mid + 1; else hi = mid;
+    }
+    if (dir > 0 && lo < s->count) {
+        *hit = s->hits[lo];
+        found = 1;
+    } else if (dir < 0 && lo > 0) {
+        *hit = s->hits[lo - 1];
+        found = 1;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+void search_progress(struct search *s, size_t *count, size_t *scanned) {
+    pthread_mutex_lock(&s->lock);
+    *count = s->count;
+    *scanned = s->running ? s->scanned : s->size;
+    pthread_mutex_unlock(&s->lock);
+}
+
+int search_fd(const struct search *s) {
+    return s->notify[0];
+}
+
+void search_drain(struct search *s) {
+    char buf[64];
+    while (read(s->notify[0], buf, sizeof(buf)) > 0) {
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <pthread.h>
+#include <regex.h>
+#include <stddef.h>
+
+// Background regex search over a file.
+//
+// A worker thread maps the file on its own (so the pager may remap or
+// follow its copy freely) and scans it in chunks of whole lines, collecting
+// the start offset of every matching line. Hits are published after each
+// chunk and a byte is written to `notify_fd`, so the UI can poll() for
+// progress and jump to the first hit while the rest is still being scanned.
+// A gzip file is decompressed as it is scanned; hits are offsets into the
+// decompressed text and `size` becomes its length once the scan is done.
+// A file truncated under the worker's mapping fails the search, provided
+// map_guard_init() was called (see mapguard.h); otherwise SIGBUS kills.
+struct search {
+    regex_t re;
+    int fd;                // own dup of the file, or -1 to search `data` in place
+    const char *data;
+    size_t size;           // bytes to search; extended by search_grow()
+    int notify[2];         // worker -> UI wakeup pipe
+
+    pthread_t thread;
+    int thread_valid;      // `thread` has not been joined yet
+    int running;           // the worker is scanning
+    pthread_mutex_t lock;  // guards everything below
+    size_t *hits;          // line starts of matching lines, ascending
+    size_t count, cap;
+    size_t scanned;        // [0, scanned) has been searched
+    int cancel;
+    int failed;
+};
+
+// Compile `pattern` (POSIX ERE) and start scanning [0, size). On a bad
+// pattern returns -1 with the regerror() text in `err`.
+int search_start(struct search *s, const char *pattern, int fd,
+                 const char *data, size_t size, char *err, size_t errlen);
+// Stop the worker and release everything.
+void search_stop(struct search *s);
+// The file grew: also scan up to `size`.
+int search_grow(struct search *s, const char *data, size_t size);
+// The file was replaced or truncated: forget all hits and scan it afresh.
+int search_restart(struct search *s, int fd, const char *data, size_t size);
+
+// First hit at or after (dir > 0), or last hit before (dir < 0), `from`.
+// Returns 1 when found, 0 when there is none in the part searched so far.
+int search_find(struct search *s, size_t from, int dir, size_t *hit);
+// Hits found and bytes scanned so far; `scanned` equals the size once done.
+void search_progress(struct search *s, size_t *count, size_t *scanned);
+// Fd that becomes readable when new hits are published.
+int search_fd(const struct search *s);
+// Empty the wakeup pipe after poll() reported it readable.
+void search_drain(struct search *s);
+
+#endif
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE
+#include "text.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gzsrc.h"
+#include "nlscan.h"
+
+static int grow_starts(struct text *t) {
+    size_t ncap = t->cap ? t->cap * 2 : 1024;
+    size_t *ns = realloc(t->starts, ncap * sizeof(*ns));
+    if (ns == NULL) return -1;
+    t->starts = ns;
+    t->cap = ncap;
+    return 0;
+}
+
+static int push_start(struct text *t, size_t off) {
+    if (t->count == t->cap && grow_starts(t) != 0) return -1;
+    t->starts[t->count++] = off;
+    return 0;
+}
+
+int text_final(const struct text *t) {
+    return t->gz == NULL || gz_done(t->gz);
+}
+
+int index_complete(const struct text *t) {
+    return t->indexed >= t->size && text_final(t);
+}
+
+int index_percent(const struct text *t) {
+    if (t->gz != NULL) return gz_percent(t->gz);
+    return t->size ? (int)(t->indexed * 100 / t->size) : 100;
+}
+
+int index_chunk(struct text *t, size_t budget) {
+    size_t from = t->indexed, to;
+    const char *p;
+
+    if (t->gz != NULL) {
+        // Decompressed bytes are indexed as they come out, then dropped
+        ssize_t n = gz_advance(t->gz, budget, &p);
+        if (n < 0) return -1;
+        t->size += (size_t)n;
+        to = t->size;
+    } else {
+        to = (t->size - from > budget) ? from + budget : t->size;
+        p = t->data + from;
+    }
+
+    if (from < to && from == 0 && push_start(t, 0) != 0) return -1;
+    // The kernel writes straight into starts[]; it stops early only when
+    // starts[] is full, in which case it is grown and the scan resumed.
+    for (size_t at = from; at < to; ) {
+        size_t scanned;
+        if (t->count == t->cap && grow_starts(t) != 0) return -1;
+        t->count += nl_scan(p + (at - from), to - at, at,
+                            t->starts + t->count, t->cap - t->count, &scanned);
+        at += scanned;
+    }
+    t->indexed = to;
+    // A trailing newline does not open a new line
+    if (index_complete(t) && t->count > 0 && t->starts[t->count - 1] == t->size) t->count--;
+    return 0;
+}
+
+// Fallback for inputs that cannot be mapped (pipes, character devices).
+static int slurp(struct text *t, int fd) {
+    size_t cap = 1 << 16;
+    char *buf = malloc(cap);
+    ssize_t r;
+
+    if (buf == NULL) return -1;
+    while ((r = read(fd, buf + t->size, cap - t->size)) > 0) {
+        t->size += (size_t)r;
+        if (t->size == cap) {
+            char *nb = realloc(buf, cap * 2);
+            if (nb == NULL) {
+                free(buf);
+                return -1;
+            }
+            buf = nb;
+            cap *= 2;
+        }
+    }
+    if (r < 0) {
+        free(buf);
+        return -1;
+    }
+    t->data = buf;
+    return 0;
+}
+
+int load_text(struct text *t, const char *path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    memset(t, 0, sizeof(*t));
+    t->fd = fd;
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1) return -1;
+
+    if (S_ISREG(st.st_mode)) {
+        t->gz = gz_open(fd);
+        if (t->gz != NULL) return 0;
+        if (errno != 0) return -1;
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            t->data = m;
+            t->size = (size_t)st.st_size;
+            t->mapped = 1;
+        }
+    }
+    if (!t->mapped && !(S_ISREG(st.st_mode) && st.st_size == 0)) {
+        if (slurp(t, fd) != 0) return -1;
+    }
+    return 0;
+}
+
+void free_text(struct text *t) {
+    if (t->mapped)
+        munmap((void *)t->data, t->size);
+    else
+        free((void *)t->data);
+    gz_close(t->gz);
+    if (t->fd != -1) close(t->fd);
+    free(t->starts);
+}
+
+int resize_text(struct text *t, int fd, size_t size) {
+    if (size == t->size) return 0;
+    if (size < t->size) {
+        t->count = 0;
+        t->indexed = 0;
+    } else if (t->size > 0 && t->indexed == t->size && t->data[t->size - 1] == '\n') {
+        // The old trailing newline now opens a line
+        if (push_start(t, t->size) != 0) return -1;
+    }
+
+    if (size == 0) {
+        if (t->mapped) munmap((void *)t->data, t->size);
+        t->data = NULL;
+        t->mapped = 0;
+    } else {
+        void *m = t->mapped ? mremap((void *)t->data, t->size, size, MREMAP_MAYMOVE)
+                            : mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) return -1;
+        t->data = m;
+        t->mapped = 1;
+    }
+    t->size = size;
+    return 0;
+}
+
+const char *text_piece(const struct text *t, size_t off, size_t *start, size_t *end) {
+    if (t->gz != NULL) {
+        const char *p = gz_page(t->gz, off, start, end);
+        if (p != NULL) return p;
+        // Out of memory: show the byte as unreadable rather than give up
+        *start = off;
+        *end = off + 1;
+        return "?";
+    }
+    *start = 0;
+    *end = t->size;
+    return t->data;
+}
+
+char text_byte(const struct text *t, size_t off) {
+    size_t start, end;
+    return text_piece(t, off, &start, &end)[off - start];
+}
+
+int find_line(const struct text *t, size_t off, size_t *line) {
+    size_t lo = 0, hi = t->count;
+
+    if (off > t->indexed || t->count == 0) return 0;
+    while (lo + 1 < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (t->starts[mid] <= off) lo = mid; else hi = mid;
+    }
+    if (t->starts[lo] != off) return 0;
+    *line = lo;
+    return 1;
+}
+
+size_t line_end(const struct text *t, size_t off) {
+    size_t k;
+
+    // An indexed line ends where the next one starts: no need to scan it
+    if (find_line(t, off, &k) && k + 1 < t->count) return t->starts[k + 1];
+    while (off < t->size) {
+        size_t start, end;
+        const char *p = text_piece(t, off, &start, &end);
+        const char *nl = memchr(p + (off - start), '\n', end - off);
+        if (nl) return start + (size_t)(nl - p) + 1;
+        off = end;
+    }
+    return t->size;
+}
+
+size_t next_line(const struct text *t, size_t off) {
+    size_t k, end;
+
+    if (find_line(t, off, &k) && k + 1 < t->count) return t->starts[k + 1];
+    end = line_end(t, off);
+    return end < t->size ? end : off;
+}
+
+size_t line_start(const struct text *t, size_t off) {
+    if (off <= t->indexed && t->count > 0) {
+        size_t lo = 0, hi = t->count;
+        while (lo + 1 < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (t->starts[mid] <= off) lo = mid; else hi = mid;
+        }
+        return t->starts[lo];
+    }
+    for (size_t pos = off; pos > 0; ) {
+        size_t start, end;
+        const char *p = text_piece(t, pos - 1, &start, &end);
+        const char *nl = memrchr(p, '\n', pos - start);
+        if (nl) return start + (size_t)(nl - p) + 1;
+        pos = start;
+    }
+    return 0;
+}
+
+size_t prev_line(const struct text *t, size_t off) {
+    size_t k;
+
+    if (off == 0) return 0;
+    if (find_line(t, off, &k)) return t->starts[k - 1];
+    // off - 1 is the newline ending the previous line
+    return line_start(t, off - 1);
+}
+
+size_t last_page_top(const struct text *t, size_t page) {
+    size_t off = prev_line(t, t->size);
+    for (size_t i = 1; i < page && off > 0; i++)
+        off = prev_line(t, off);
+    return off;
+}
+
+size_t content_len(const struct text *t, size_t off, size_t end) {
+    return (end > off && text_byte(t, end - 1) == '\n') ? end - off - 1 : end - off;
+}
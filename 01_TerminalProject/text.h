@@ -0,0 +1,68 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stddef.h>
+
+// A loaded file. The contents are mapped read-only and every line is
+// described only by the offset of its first byte, so no line is copied.
+// The index is built lazily: starts[] covers the lines whose first byte
+// lies at or before `indexed`, the rest of the file is still unscanned.
+// A gzip file has no `data`: it is decompressed while being indexed, so
+// `size` grows with the index, and its bytes are read back through gz_page().
+struct text {
+    const char *data;
+    size_t size;
+    int mapped;      // data comes from mmap() rather than malloc()
+    int fd;          // kept open for the background search
+    struct gzsrc *gz;
+    size_t *starts;  // starts[i] = offset of line i
+    size_t count;
+    size_t cap;
+    size_t indexed;  // bytes [0, indexed) have been scanned for newlines
+};
+
+// Bytes indexed between two polls of the keyboard. Small enough to keep
+// key handling responsive, large enough to keep the scan at memory speed.
+#define INDEX_CHUNK (4u << 20)
+
+// Open and map `path` (or read it, when it cannot be mapped). No line is
+// indexed yet. On failure free_text() must still be called.
+int load_text(struct text *t, const char *path);
+void free_text(struct text *t);
+// Follow the file to a new size without touching what is already indexed:
+// growth only extends the mapping, so the indexer resumes at the old end.
+// A shrinking file was truncated and rewritten, so its index starts over.
+int resize_text(struct text *t, int fd, size_t size);
+
+// Extend the index over at most `budget` more bytes.
+int index_chunk(struct text *t, size_t budget);
+int index_complete(const struct text *t);
+int index_percent(const struct text *t);
+// The whole text is known (a gzip file may not be fully decompressed yet).
+int text_final(const struct text *t);
+
+// The contiguous piece of text holding offset `off` (< size): the whole
+// mapping, or one decompressed page of a gzip file. It spans [*start, *end)
+// and the returned pointer corresponds to *start.
+const char *text_piece(const struct text *t, size_t off, size_t *start, size_t *end);
+char text_byte(const struct text *t, size_t off);
+
+// Line number of the line starting at `off`, if the index already reaches it.
+int find_line(const struct text *t, size_t off, size_t *line);
+// Start of the line holding offset `off`: a binary search when the index
+// reaches it, otherwise a scan back to the previous newline.
+size_t line_start(const struct text *t, size_t off);
+// Offset just past the line starting at `off` (past its newline, if any):
+// from the index when it reaches the next line, otherwise a scan.
+size_t line_end(const struct text *t, size_t off);
+// Length of the line [off, end) without its newline.
+size_t content_len(const struct text *t, size_t off, size_t end);
+// Start of the line after the one at `off`; `off` itself if it is the last.
+size_t next_line(const struct text *t, size_t off);
+// Start of the line before the one at `off`; 0 for the first line.
+size_t prev_line(const struct text *t, size_t off);
+// Top line of the last full page: found by walking back from EOF, so it
+// is available before the index reaches the end of the file.
+size_t last_page_top(const struct text *t, size_t page);
+
+#endif
@@ -0,0 +1,278 @@
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "subst.h"
+
+// Reproducible corpora for esub's matchers, and how fast and how evenly
+// each matcher gets through them: a baseline for engine changes.
+// Usage: bench_corpus [-w DIR] [SCALE]   (SCALE multiplies the sizes, default 1)
+//
+// The corpora come from a fixed seed, so every run, and every build being
+// compared, sees the same bytes:
+//   log    16 MiB of log lines: levels, key=value pairs, quoted requests,
+//          IP addresses, the odd UTF-8 name and ERROR line
+//   long   4 lines of 256 KiB to 1 MiB of words and numbers
+//   patho  lines of 256 B to 8 KiB that make a backtracking matcher rescan
+//          from every start: long runs of one letter or pair, no terminator
+// Each corpus runs with its own patterns, one substitute_line() call per
+// line, with the posix and the dfa matcher. Reported per run: throughput,
+// and the per-line latency at the median, 99th and 99.9th percentile and
+// its maximum, with the slowest line. The outputs of the two matchers are
+// compared line by line, so the corpora double as a differential fuzz of
+// the dfa matcher against glibc; a difference fails the run.
+// -w DIR also writes the corpora there (log.txt, long.txt, patho.txt), to
+// feed to esub or sed.
+
+struct corpus {
+    const char *name;
+    struct sbuf text;          // lines, each ending in '\n'
+    size_t *start;             // line i is text[start[i], start[i + 1] - 1)
+    size_t nlines;
+};
+
+struct pattern {
+    const char *corpus;
+    const char *re, *subst;
+    int global;
+};
+
+static const struct pattern patterns[] = {
+    { "log", "ERROR code=([0-9]+)", "E\\1", 0 },
+    { "log", "user=([a-z]+)@([a-z.]+)", "\\2/\\1", 0 },
+    { "log", "\"([A-Z]+) ([^\"]*)\"", "\\2", 0 },
+    { "log", "([0-9]+\\.){3}([0-9]+)", "ip", 0 },
+    { "log", "([a-z]+)=([0-9]+)", "\\2=\\1", 1 },
+    { "long", "([a-z]+) ([0-9]+)$", "\\2", 0 },
+    { "long", "(foo|bar|baz)[0-9]+", "X", 1 },
+    { "long", "[A-Z]{3,}", "_", 1 },
+    { "patho", "([a-z]+) ([a-z]+)", "\\2 \\1", 0 },
+    { "patho", "(a|aa)*c", "c", 0 },
+    { "patho", "(x+x+)+y", "y", 0 },
+    { "patho", "(.*)=(.*);", "\\1", 0 },
+    { "patho", "(\\w+\\s?)+$", "w", 0 },
+};
+
+static unsigned long long seed = 88172645463325252ull;
+
+static unsigned long long rnd(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add(struct sbuf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    sbuf_reserve(b, (size_t)n);
+    va_start(ap, fmt);
+    vsnprintf(b->data + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+}
+
+static void add_run(struct sbuf *b, const char *unit, size_t n) {
+    size_t len = strlen(unit);
+    for (size_t i = 0; i < n; i++) sbuf_append_char(b, unit[i % len]);
+}
+
+static const char *word(void) {
+    static const char *words[] = {
+        "alpha", "bravo", "cache", "delta", "epoch", "fetch", "gamma", "hotel", "index",
+        "jolly", "kilo", "lemon", "metro", "nodes", "omega", "proxy", "queue", "retry",
+        "shard", "token", "umbra", "vivid", "write", "xenon", "yield", "zulu",
+    };
+    return words[rnd() % (sizeof(words) / sizeof(words[0]))];
+}
+
+static void make_log(struct sbuf *b, size_t size) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN" };
+    static const char *methods[] = { "GET", "GET", "POST", "PUT", "DELETE" };
+
+    for (unsigned long id = 0; b->len < size; id++) {
+        add(b, "2025-10-17T%02lu:%02lu:%02lu.%03lluZ ", id / 3600000 % 24, id / 60000 % 60,
+            id / 1000 % 60, rnd() % 1000);
+        unsigned long long r = rnd();
+        if (r % 1000 == 7) {
+            add(b, "ERROR worker-%llu code=%llu %s failed\n", r % 32, r % 997, word());
+            continue;
+        }
+        add(b, "%s [%s] client=%llu.%llu.%llu.%llu user=%s%s@%s.example ", levels[r % 5], word(),
+            r >> 8 & 255, r >> 16 & 255, r >> 24 & 255, r >> 32 & 255, word(),
+            r % 97 == 0 ? "\xc3\xa9" : "", word());
+        add(b, "req=\"%s /%s/%s?id=%lu\" status=%llu took=%llums\n", methods[r % 5], word(),
+            word(), id, 200 + r % 4 * 100, r % 2000);
+    }
+}
+
+static void make_long(struct sbuf *b, size_t lines) {
+    for (size_t i = 0; i < lines; i++) {
+        size_t size = (256u << 10) + rnd() % (768u << 10), end = b->len + size;
+        while (b->len < end) {
+            unsigned long long r = rnd();
+            if (r % 50 == 0) add(b, "%s%llu ", r % 3 == 0 ? "foo" : r % 3 == 1 ? "bar" : "baz", r % 1000);
+            else if (r % 70 == 0) add(b, "ABCD ");
+            else add(b, "%s %llu ", word(), r % 100000);
+        }
+        add(b, "%s %llu\n", word(), rnd() % 100);
+    }
+}
+
+static void make_patho(struct sbuf *b, size_t rounds) {
+    for (size_t k = 0; k < rounds; k++) {
+        for (size_t n = 256; n <= 8192; n *= 2) {
+            add_run(b, "a", n);
+            add(b, " 1\n");                     // one word, and no second one
+            add_run(b, "x", n);
+            sbuf_append_char(b, '\n');
+            add_run(b, "k=v", n);
+            sbuf_append_char(b, '\n');
+            add_run(b, "ab ", n);
+            add(b, "!\n");
+        }
+    }
+}
+
+static void index_lines(struct corpus *c) {
+    size_t n = 0;
+    for (size_t i = 0; i < c->text.len; i++) n += c->text.data[i] == '\n';
+    c->start = xmalloc((n + 1) * sizeof(*c->start));
+    c->start[0] = 0;
+    c->nlines = 0;
+    for (size_t i = 0; i < c->text.len; i++) {
+        if (c->text.data[i] == '\n') c->start[++c->nlines] = i + 1;
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Rewrites every line of `c` into `out` (its end in ends[i]) and times
+// each one into lat[i]; returns the total.
+static double run(const struct esub *e, const struct corpus *c, struct sbuf *out, size_t *ends,
+                  double *lat) {
+    double total = 0;
+
+    out->len = 0;
+    for (size_t i = 0; i < c->nlines; i++) {
+        const char *line = c->text.data + c->start[i];
+        size_t len = c->start[i + 1] - c->start[i] - 1;
+        double start = now();
+        substitute_line(e, line, len, out);
+        lat[i] = now() - start;
+        total += lat[i];
+        ends[i] = out->len;
+    }
+    return total;
+}
+
+static void report(const struct corpus *c, const struct pattern *p, const char *matcher,
+                   double total, const double *lat) {
+    double *sorted = xmalloc(c->nlines * sizeof(*sorted));
+    size_t worst = 0;
+
+    memcpy(sorted, lat, c->nlines * sizeof(*sorted));
+    qsort(sorted, c->nlines, sizeof(*sorted), cmp_double);
+    for (size_t i = 1; i < c->nlines; i++) {
+        if (lat[i] > lat[worst]) worst = i;
+    }
+#define PCT(q) (sorted[(size_t)((q) * (double)(c->nlines - 1))] * 1e6)
+    printf("%-6s %-26s %-6s %8.1f %10.0f %9.2f %9.2f %9.2f %11.2f  %zu\n", c->name, p->re,
+           matcher, (double)c->text.len / total / 1e6, (double)c->nlines / total, PCT(0.5),
+           PCT(0.99), PCT(0.999), lat[worst] * 1e6, worst + 1);
+#undef PCT
+    free(sorted);
+}
+
+static void write_corpus(const char *dir, const struct corpus *c) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.txt", dir, c->name);
+    FILE *f = fopen(path, "w");
+    if (f == NULL || fwrite(c->text.data, 1, c->text.len, f) != c->text.len || fclose(f) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *dir = NULL;
+    int opt, status = 0;
+
+    while ((opt = getopt(argc, argv, "w:")) != -1) {
+        if (opt == 'w') dir = optarg;
+        else {
+            fprintf(stderr, "Usage: %s [-w DIR] [SCALE]\n", argv[0]);
+            return 2;
+        }
+    }
+    size_t scale = optind < argc ? strtoul(argv[optind], NULL, 10) : 1;
+    if (scale == 0) scale = 1;
+
+    struct corpus corpora[] = { { .name = "log" }, { .name = "long" }, { .name = "patho" } };
+    size_t ncorpora = sizeof(corpora) / sizeof(corpora[0]);
+    for (size_t i = 0; i < ncorpora; i++) sbuf_init(&corpora[i].text);
+    make_log(&corpora[0].text, scale * (16u << 20));
+    make_long(&corpora[1].text, scale * 4);
+    make_patho(&corpora[2].text, scale * 2);
+    for (size_t i = 0; i < ncorpora; i++) {
+        index_lines(&corpora[i]);
+        if (dir != NULL) write_corpus(dir, &corpora[i]);
+    }
+
+    printf("%-6s %-26s %-6s %8s %10s %9s %9s %9s %11s  %s\n", "corpus", "pattern", "engine",
+           "MB/s", "lines/s", "p50 us", "p99 us", "p99.9 us", "max us", "slowest line");
+    for (size_t k = 0; k < sizeof(patterns) / sizeof(patterns[0]); k++) {
+        const struct pattern *p = &patterns[k];
+        static const char *matchers[] = { "posix", "dfa" };
+        const struct corpus *c = corpora;
+        while (strcmp(c->name, p->corpus) != 0) c++;
+
+        struct sbuf out[2];
+        size_t *ends[2];
+        double *lat = xmalloc(c->nlines * sizeof(*lat));
+        for (int m = 0; m < 2; m++) {
+            struct esub e;
+            esub_init(&e, p->re, p->subst, p->global, matchers[m]);
+            sbuf_init(&out[m]);
+            ends[m] = xmalloc(c->nlines * sizeof(*ends[m]));
+            double total = run(&e, c, &out[m], ends[m], lat);
+            report(c, p, matchers[m], total, lat);
+            esub_free(&e);
+        }
+        for (size_t i = 0; i < c->nlines; i++) {
+            size_t from = i ? ends[0][i - 1] : 0;
+            if (ends[0][i] != ends[1][i] ||
+                memcmp(out[0].data + from, out[1].data + from, ends[0][i] - from) != 0) {
+                fprintf(stderr, "%s line %zu: dfa and posix differ for %s\n", c->name, i + 1, p->re);
+                status = 1;
+                break;
+            }
+        }
+        for (int m = 0; m < 2; m++) {
+            free(out[m].data);
+            free(ends[m]);
+        }
+        free(lat);
+    }
+
+    for (size_t i = 0; i < ncorpora; i++) {
+        free(corpora[i].text.data);
+        free(corpora[i].start);
+    }
+    return status;
+}
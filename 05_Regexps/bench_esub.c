@@ -0,0 +1,213 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "subst.h"
+
+// Throughput of the substitution engine on an in-memory log where few
+// lines match: glibc regexec() alone, the dfa matcher alone, and the dfa
+// matcher behind the literal prefilter (what esub does by default).
+// Usage: bench_esub [MiB]   (default 64)
+//
+// One line in HIT_EVERY carries "ERROR code=N"; the others are ordinary
+// INFO/DEBUG lines. Each pattern runs over the whole buffer the way the
+// stream mode does (one substitute_lines() call per block, output reset in
+// between), and the outputs are compared so a wrong skip or a wrong match
+// shows up as a failure rather than as a speedup.
+//
+// Then a script of several rules, rarely matching, runs once per rule (one
+// esub after another), once with the rules tried in turn on each line, and
+// once with the combined scan that finds the first rule to apply.
+//
+// Last, the log is written to a file and rewritten to /dev/null the way
+// esub -j does it, with 1, 2, 4, ... threads up to the number of CPUs, with
+// a pattern that matches every line so the work is in the matcher.
+
+#define HIT_EVERY 1000
+#define BLOCK (1u << 20)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *make_log(size_t size, size_t *len, size_t *lines) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN" };
+    unsigned long long seed = 88172645463325252ull;
+    char *buf = xmalloc(size + 256);
+    size_t n = 0, id;
+
+    for (id = 0; n < size; id++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        if (id % HIT_EVERY == HIT_EVERY - 1)
+            n += (size_t)sprintf(buf + n, "2025-10-17 %02lu:%02lu:%02lu ERROR worker-%llu code=%llu\n",
+                                 (unsigned long)(id / 3600 % 24), (unsigned long)(id / 60 % 60),
+                                 (unsigned long)(id % 60), seed % 32, seed % 1000);
+        else
+            n += (size_t)sprintf(buf + n, "2025-10-17 %02lu:%02lu:%02lu %s worker-%llu request id=%lu took %llums\n",
+                                 (unsigned long)(id / 3600 % 24), (unsigned long)(id / 60 % 60),
+                                 (unsigned long)(id % 60), levels[seed % 5], seed % 32,
+                                 (unsigned long)id, seed % 1000);
+    }
+    *len = n;
+    *lines = id;
+    return buf;
+}
+
+// Seconds to rewrite data[0, len); the last block's output is left in `out`
+// and the total output size in *emitted.
+static double run(const struct esub *e, const char *data, size_t len, struct sbuf *out,
+                  size_t *emitted) {
+    size_t pos = 0;
+    double start = now();
+
+    *emitted = 0;
+    while (pos < len) {
+        size_t n = len - pos < BLOCK ? len - pos : BLOCK;
+        out->len = 0;
+        pos += substitute_lines(e, data + pos, n, pos + n == len, out);
+        *emitted += out->len;
+    }
+    return now() - start;
+}
+
+// Seconds to rewrite all of data[0, len) into `out`.
+static double rewrite(const struct esub *e, const char *data, size_t len, struct sbuf *out) {
+    double start = now();
+
+    out->len = 0;
+    substitute_lines(e, data, len, 1, out);
+    return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+    static const char *cases[][3] = {
+        { "", "ERROR code=([0-9]+)", "ERROR code=<\\1>" },
+        { "-g", "code=([0-9]+)", "c=\\1" },
+        { "", "worker-([0-9]+) code", "w\\1 code" },
+        { "", "(ERROR|FATAL) code", "\\1!" },   // the literal is " code"
+        { "", "ERROR|FATAL", "E" },             // top-level '|': no prefilter
+        { "", "took ([0-9]+)ms", "\\1" },       // matches almost every line
+    };
+    size_t mib = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+    size_t len, lines;
+    char *data = make_log(mib << 20, &len, &lines);
+    int status = 0;
+
+    printf("%zu MiB, %zu lines, 1 in %d with ERROR\n", len >> 20, lines, HIT_EVERY);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        static const char *matchers[] = { "posix", "dfa", NULL };
+        int global = cases[i][0][0] != '\0';
+        struct esub e;
+        struct sbuf out[3];
+        size_t emitted[3];
+        double t[3];
+
+        printf("%-3s %-26s", cases[i][0], cases[i][1]);
+        for (int k = 0; k < 3; k++) {
+            esub_init(&e, cases[i][1], cases[i][2], global, matchers[k]);
+            e.prefilter = matchers[k] == NULL;
+            sbuf_init(&out[k]);
+            t[k] = run(&e, data, len, &out[k], &emitted[k]);
+            if (k == 2)
+                printf("  literal %-12.*s", (int)(e.rules[0].lit_len ? e.rules[0].lit_len : 1),
+                       e.rules[0].lit_len ? e.rules[0].lit : "-");
+            printf("  %s %9.0f lines/s %7.1f MB/s", k == 0 ? "regexec" : k == 1 ? "dfa" : "+prefilter",
+                   lines / t[k], len / t[k] / 1e6);
+            esub_free(&e);
+        }
+        printf("  x%.1f\n", t[0] / t[2]);
+        for (int k = 1; k < 3; k++) {
+            if (emitted[k] != emitted[0] || out[k].len != out[0].len ||
+                memcmp(out[k].data, out[0].data, out[0].len) != 0) {
+                fprintf(stderr, "output differs from regexec's: %s %s\n",
+                        k == 1 ? "dfa" : "prefilter", cases[i][1]);
+                status = 1;
+            }
+        }
+        for (int k = 0; k < 3; k++) free(out[k].data);
+    }
+
+    static const struct rule_spec script[] = {
+        { "ERROR code=([0-9]+)", "E=\\1", 0 },
+        { "FATAL (.*)", "F \\1", 0 },
+        { "panic: ([a-z]+)", "P \\1", 0 },
+        { "user=([a-z]+)@", "u=\\1", 0 },
+        { "timeout after ([0-9]+)s", "T\\1", 0 },
+        { "WARN worker-3 ", "W3 ", 0 },
+        { "took 99[0-9]ms", "slow", 0 },
+        { "id=4242[0-9] ", "id ", 1 },
+    };
+    size_t nscript = sizeof(script) / sizeof(script[0]);
+    struct sbuf pass[2], out[2];
+    double t[3] = { 0, 0, 0 };
+    const char *in = data;
+    size_t inlen = len;
+    sbuf_init(&pass[0]);
+    sbuf_init(&pass[1]);
+    for (size_t i = 0; i < nscript; i++) {
+        struct esub e;
+        esub_init(&e, script[i].pattern, script[i].subst, script[i].global, NULL);
+        t[0] += rewrite(&e, in, inlen, &pass[i % 2]);
+        in = pass[i % 2].data;
+        inlen = pass[i % 2].len;
+        esub_free(&e);
+    }
+    for (int k = 0; k < 2; k++) {
+        struct esub e;
+        esub_init_rules(&e, script, nscript, NULL);
+        if (k == 0) {
+            pattern_set_free(e.scan);
+            e.scan = NULL;
+        }
+        sbuf_init(&out[k]);
+        t[k + 1] = rewrite(&e, data, len, &out[k]);
+        esub_free(&e);
+    }
+    printf("%zu rules: one pass per rule %.1f MB/s, rules in turn %.1f MB/s, combined scan %.1f MB/s\n",
+           nscript, len / t[0] / 1e6, len / t[1] / 1e6, len / t[2] / 1e6);
+    for (int k = 0; k < 2; k++) {
+        if (out[k].len != inlen || memcmp(out[k].data, in, inlen) != 0) {
+            fprintf(stderr, "output differs from one pass per rule: %s\n",
+                    k == 0 ? "rules in turn" : "combined scan");
+            status = 1;
+        }
+        free(out[k].data);
+    }
+    free(pass[0].data);
+    free(pass[1].data);
+
+    char path[] = "/tmp/bench_esubXXXXXX";
+    int fd = mkstemp(path);
+    int null = open("/dev/null", O_WRONLY);
+    if (fd < 0 || null < 0) {
+        perror("bench_esub");
+        return 1;
+    }
+    write_all(fd, data, len);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("threads (-j), took ([0-9]+)ms:");
+    for (int jobs = 1; jobs <= cpus || jobs == 1; jobs *= 2) {
+        struct esub *e = xmalloc((size_t)jobs * sizeof(*e));
+        for (int i = 0; i < jobs; i++) esub_init(&e[i], "took ([0-9]+)ms", "\\1", 0, NULL);
+        lseek(fd, 0, SEEK_SET);
+        double start = now();
+        substitute_parallel(e, jobs, fd, null);
+        printf("  %d: %.0f MB/s", jobs, len / (now() - start) / 1e6);
+        fflush(stdout);
+        for (int i = 0; i < jobs; i++) esub_free(&e[i]);
+        free(e);
+    }
+    printf("\n");
+    close(null);
+    close(fd);
+    unlink(path);
+    free(data);
+    return status;
+}
@@ -0,0 +1,878 @@
+#include "match.h"
+#include "subst.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The dfa matcher. The ERE is parsed into a tree and compiled into a
+// program for a Thompson NFA:
+//
+//   CHAR set   consume one byte in the set
+//   SPLIT x y  continue at x and at y, x preferred
+//   JMP x      continue at x
+//   SAVE n     record the position in capture slot n
+//   BOL, EOL   continue only at the start / end of the line
+//   MARK r     record the position in register r
+//   CHECK r    continue only if the position moved since MARK r
+//   MATCH n    pattern n matched (always 0 but in a pattern set)
+//
+// A lazy DFA over sets of program counters answers "is there a match in
+// line[pos, len)" with one table lookup per byte; states and transitions
+// are built on first use and thrown away when the cache fills up. Lines it
+// accepts go to a Pike VM, which runs all threads of the NFA in lockstep,
+// each with its own captures. Threads are kept in priority order (earlier
+// start, then first alternative, then more repetitions), and the match
+// reported is the longest one from the leftmost start; among paths of that
+// same extent the highest-priority one wins. This is how glibc assigns
+// groups too, e.g. (a|ab)(c|bcd) on "abcd" gives "a" and "bcd". Like glibc,
+// an optional iteration that matches nothing does not count: a repeated
+// body that can be empty is wrapped in MARK/CHECK, so ((c)*){1,2} on "c"
+// keeps \1 = "c" rather than the empty second round. For the DFA both are
+// no-ops, as skipping an empty iteration never changes what matches.
+//
+// A pattern set (match.h) is the same machinery without the Pike VM: the
+// patterns are alternatives of one program, each ending in its own MATCH,
+// and a DFA state knows the lowest pattern that matches in it.
+
+#define MAX_PROG 10000         // instructions; larger patterns stay with posix
+#define MAX_STATES 2048        // cached DFA states before the cache is flushed
+#define NCAP (2 * MAX_GROUPS)
+#define MAX_REGS 8             // nullable repetitions; more stay with posix
+#define NSLOT (NCAP + MAX_REGS) // per thread: captures, then registers
+#define UNSET ((size_t)-1)
+
+enum { CHAR, SPLIT, JMP, SAVE, BOL, EOL, MARK, CHECK, MATCH };
+
+struct inst {
+    int op;
+    int x, y;                  // CHAR: x = set; SPLIT/JMP: targets; SAVE, MARK, CHECK: x = slot;
+                               // MATCH: x = pattern
+};
+
+struct byteset {
+    uint32_t bits[8];
+};
+
+static int in_set(const struct byteset *s, unsigned char c) {
+    return (s->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void set_add(struct byteset *s, unsigned char c) {
+    s->bits[c >> 5] |= (uint32_t)1 << (c & 31);
+}
+
+// --- Parsing ---
+
+enum { N_EMPTY, N_SET, N_CAT, N_ALT, N_REP, N_GROUP, N_BOL, N_EOL };
+
+struct node {
+    int type;
+    int a, b;                  // children (CAT, ALT), child (REP, GROUP)
+    int min, max;              // REP; max < 0 for no limit
+    int n;                     // SET: set index; GROUP: group number; REP: register or -1
+};
+
+struct parser {
+    const char *p;
+    struct node *nodes;
+    size_t nnodes, capnodes;
+    struct byteset *sets;
+    size_t nsets, capsets;
+    int groups;
+    int unsupported;
+};
+
+static int new_node(struct parser *ps, int type, int a, int b) {
+    if (ps->nnodes == ps->capnodes) {
+        ps->capnodes = ps->capnodes ? 2 * ps->capnodes : 64;
+        ps->nodes = realloc(ps->nodes, ps->capnodes * sizeof(*ps->nodes));
+        if (ps->nodes == NULL) {
+            fprintf(stderr, "esub: out of memory\n");
+            exit(2);
+        }
+    }
+    struct node *n = &ps->nodes[ps->nnodes];
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->a = a;
+    n->b = b;
+    return (int)ps->nnodes++;
+}
+
+static int new_set(struct parser *ps, struct byteset **set) {
+    if (ps->nsets == ps->capsets) {
+        ps->capsets = ps->capsets ? 2 * ps->capsets : 16;
+        ps->sets = realloc(ps->sets, ps->capsets * sizeof(*ps->sets));
+        if (ps->sets == NULL) {
+            fprintf(stderr, "esub: out of memory\n");
+            exit(2);
+        }
+    }
+    *set = &ps->sets[ps->nsets];
+    memset(*set, 0, sizeof(**set));
+    int node = new_node(ps, N_SET, -1, -1);
+    ps->nodes[node].n = (int)ps->nsets++;
+    return node;
+}
+
+static int char_node(struct parser *ps, unsigned char c) {
+    struct byteset *s;
+    int node = new_set(ps, &s);
+    set_add(s, c);
+    return node;
+}
+
+// \w, \s and [:name:]: 1 if the class is known.
+static int add_class(struct byteset *s, const char *name, size_t len, int negate) {
+    static const struct { const char *name; int (*is)(int); } classes[] = {
+        { "alpha", isalpha }, { "digit", isdigit }, { "alnum", isalnum },
+        { "upper", isupper }, { "lower", islower }, { "space", isspace },
+        { "blank", isblank }, { "punct", ispunct }, { "print", isprint },
+        { "graph", isgraph }, { "cntrl", iscntrl }, { "xdigit", isxdigit },
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (strlen(classes[i].name) != len || memcmp(classes[i].name, name, len) != 0) continue;
+        for (int c = 0; c < 256; c++) {
+            if ((classes[i].is(c) != 0) != negate) set_add(s, (unsigned char)c);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// ps->p is just past '['.
+static int parse_bracket(struct parser *ps) {
+    struct byteset *s;
+    int node = new_set(ps, &s);
+    const char *p = ps->p;
+    int negate = 0;
+
+    if (*p == '^') {
+        negate = 1;
+        p++;
+    }
+    for (int first = 1; *p != '\0' && (first || *p != ']'); first = 0) {
+        if (p[0] == '[' && p[1] == ':') {
+            const char *end = strstr(p + 2, ":]");
+            if (end == NULL || !add_class(s, p + 2, (size_t)(end - p - 2), 0)) goto unsupported;
+            p = end + 2;
+            continue;
+        }
+        if (p[0] == '[' && (p[1] == '.' || p[1] == '=')) goto unsupported; // collating elements
+        unsigned char lo = (unsigned char)*p++, hi = lo;
+        if (p[0] == '-' && p[1] != ']' && p[1] != '\0') {
+            if (p[1] == '[') goto unsupported;
+            hi = (unsigned char)p[1];
+            p += 2;
+        }
+        for (int c = lo; c <= hi; c++) set_add(s, (unsigned char)c);
+    }
+    if (*p != ']') goto unsupported;
+    ps->p = p + 1;
+    if (negate) {
+        for (int i = 0; i < 8; i++) ps->sets[ps->nodes[node].n].bits[i] ^= UINT32_MAX;
+    }
+    return node;
+
+unsupported:
+    ps->unsupported = 1;
+    return node;
+}
+
+static int parse_alt(struct parser *ps);
+
+static int parse_atom(struct parser *ps) {
+    char c = *ps->p++;
+    struct byteset *s;
+    int node;
+
+    switch (c) {
+        case '(':
+            node = new_node(ps, N_GROUP, -1, -1);
+            ps->nodes[node].n = ++ps->groups;
+            // Not nodes[node].a = parse_alt(): the call may move ps->nodes
+            int sub = parse_alt(ps);
+            ps->nodes[node].a = sub;
+            if (*ps->p != ')') ps->unsupported = 1;
+            else ps->p++;
+            return node;
+        case '[':
+            return parse_bracket(ps);
+        case '.':
+            // Like glibc's POSIX syntax (RE_DOT_NOT_NULL): anything but NUL
+            node = new_set(ps, &s);
+            for (int i = 1; i < 256; i++) set_add(s, (unsigned char)i);
+            return node;
+        case '^':
+            return new_node(ps, N_BOL, -1, -1);
+        case '$':
+            return new_node(ps, N_EOL, -1, -1);
+        case '\\':
+            if ((c = *ps->p) != '\0') ps->p++;
+            if (c == '\0' || isdigit((unsigned char)c) || strchr("bB<>`'", c) != NULL) {
+                ps->unsupported = 1; // backreferences, word and buffer anchors
+                return new_node(ps, N_EMPTY, -1, -1);
+            }
+            if (c == 'w' || c == 'W') {
+                node = new_set(ps, &s);
+                add_class(s, "alnum", 5, c == 'W');
+                if (c == 'w') set_add(s, '_');
+                else s->bits['_' >> 5] &= ~((uint32_t)1 << ('_' & 31));
+                return node;
+            }
+            if (c == 's' || c == 'S') {
+                node = new_set(ps, &s);
+                add_class(s, "space", 5, c == 'S');
+                return node;
+            }
+            return char_node(ps, (unsigned char)c);
+        case '*': case '+': case '?': case '{': case ')': case '|': case '\0':
+            ps->unsupported = 1; // nothing to repeat: leave the oddities to regcomp's syntax
+            return new_node(ps, N_EMPTY, -1, -1);
+        default:
+            return char_node(ps, (unsigned char)c);
+    }
+}
+
+static int parse_piece(struct parser *ps) {
+    int node = parse_atom(ps);
+
+    for (;;) {
+        int min, max;
+        char c = *ps->p;
+        if (c == '*') { min = 0; max = -1; ps->p++; }
+        else if (c == '+') { min = 1; max = -1; ps->p++; }
+        else if (c == '?') { min = 0; max = 1; ps->p++; }
+        else if (c == '{') {
+            char *end;
+            ps->p++;
+            min = isdigit((unsigned char)*ps->p) ? (int)strtol(ps->p, &end, 10) : 0;
+            if (!isdigit((unsigned char)*ps->p)) end = (char *)ps->p;
+            max = min;
+            if (*end == ',') {
+                end++;
+                max = isdigit((unsigned char)*end) ? (int)strtol(end, &end, 10) : -1;
+            }
+            if (*end != '}' || min > MAX_PROG || max > MAX_PROG) {
+                ps->unsupported = 1;
+                return node;
+            }
+            ps->p = end + 1;
+        } else {
+            return node;
+        }
+        int rep = new_node(ps, N_REP, node, -1);
+        ps->nodes[rep].min = min;
+        ps->nodes[rep].max = max;
+        ps->nodes[rep].n = -1;
+        node = rep;
+    }
+}
+
+static int parse_cat(struct parser *ps) {
+    int node = new_node(ps, N_EMPTY, -1, -1);
+
+    while (*ps->p != '\0' && *ps->p != '|' && *ps->p != ')' && !ps->unsupported) {
+        node = new_node(ps, N_CAT, node, parse_piece(ps));
+    }
+    return node;
+}
+
+static int parse_alt(struct parser *ps) {
+    int node = parse_cat(ps);
+
+    while (*ps->p == '|' && !ps->unsupported) {
+        ps->p++;
+        node = new_node(ps, N_ALT, node, parse_cat(ps));
+    }
+    return node;
+}
+
+// --- Compiling to the NFA program ---
+
+struct dfa_state {
+    int *pcs;                  // CHAR, EOL and MATCH instructions, sorted
+    int n;
+    int match;                 // 1 + the lowest pattern among its MATCHes, 0 if none
+    int eol;                   // matches at the end of the line; -1: not known yet
+    unsigned hash;
+};
+
+struct dfa {
+    struct inst *prog;
+    int nprog, capprog;
+    struct byteset *sets;
+    int ncap;                  // capture slots in use: 2 * (groups + 1), at most NCAP
+    int nregs;
+    int search_only;           // a pattern set: no Pike VM, so no MARK/CHECK
+
+    // Lazy DFA
+    struct dfa_state *states;
+    int nstates;
+    int *trans;                // trans[s * 256 + c]: next state, -1 not built yet
+    unsigned char *accept;     // accept[s]: states[s].match, for the inner loop
+    int *table;                // hash table of state numbers, -1 empty
+    int tablesize;
+    int start[2];              // start state at position 0 (BOL holds) and later
+    // Bytes that can begin a match after position 0, when every match has
+    // to begin with one: positions before the next such byte are skipped
+    // with no thread running (memchr() if there is a single one)
+    unsigned char first[256];
+    int first_byte;            // the single such byte, or -1
+    int skip;
+    int *stack, *work;         // scratch for closures
+    unsigned *mark, gen;
+
+    // Pike VM: two lists of threads, sparse sets over the program
+    int *dense[2], *sparse[2], n[2];
+    size_t *caps[2];           // caps[l][i * NSLOT ...]: slots of thread i
+};
+
+static int emit(struct dfa *d, int op, int x, int y) {
+    if (d->nprog == MAX_PROG) return -1;
+    if (d->nprog == d->capprog) {
+        d->capprog = d->capprog ? 2 * d->capprog : 64;
+        d->prog = realloc(d->prog, (size_t)d->capprog * sizeof(*d->prog));
+        if (d->prog == NULL) {
+            fprintf(stderr, "esub: out of memory\n");
+            exit(2);
+        }
+    }
+    d->prog[d->nprog].op = op;
+    d->prog[d->nprog].x = x;
+    d->prog[d->nprog].y = y;
+    return d->nprog++;
+}
+
+static int nullable(const struct node *nodes, int node) {
+    const struct node *n = &nodes[node];
+
+    switch (n->type) {
+        case N_SET: return 0;
+        case N_CAT: return nullable(nodes, n->a) && nullable(nodes, n->b);
+        case N_ALT: return nullable(nodes, n->a) || nullable(nodes, n->b);
+        case N_REP: return n->min == 0 || nullable(nodes, n->a);
+        case N_GROUP: return nullable(nodes, n->a);
+        default: return 1;
+    }
+}
+
+static int compile_node(struct dfa *d, struct node *nodes, int node);
+
+// One optional iteration of the body of REP node `node`.
+static int gen_iteration(struct dfa *d, struct node *nodes, int node) {
+    struct node *n = &nodes[node];
+
+    if (!nullable(nodes, n->a) || d->search_only) return compile_node(d, nodes, n->a);
+    if (n->n < 0) {
+        if (d->nregs == MAX_REGS) return -1;
+        n->n = d->nregs++;
+    }
+    if (emit(d, MARK, NCAP + n->n, 0) < 0 || compile_node(d, nodes, n->a) < 0) return -1;
+    return emit(d, CHECK, NCAP + n->n, 0) < 0 ? -1 : 0;
+}
+
+// Appends the code of `node`; -1 if the program grows too large.
+static int compile_node(struct dfa *d, struct node *nodes, int node) {
+    struct node *n = &nodes[node];
+    int split, jmp;
+
+    switch (n->type) {
+        case N_EMPTY:
+            return 0;
+        case N_SET:
+            return emit(d, CHAR, n->n, 0) < 0 ? -1 : 0;
+        case N_CAT:
+            return compile_node(d, nodes, n->a) < 0 || compile_node(d, nodes, n->b) < 0 ? -1 : 0;
+        case N_ALT:
+            if ((split = emit(d, SPLIT, 0, 0)) < 0) return -1;
+            d->prog[split].x = d->nprog;
+            if (compile_node(d, nodes, n->a) < 0 || (jmp = emit(d, JMP, 0, 0)) < 0) return -1;
+            d->prog[split].y = d->nprog;
+            if (compile_node(d, nodes, n->b) < 0) return -1;
+            d->prog[jmp].x = d->nprog;
+            return 0;
+        case N_GROUP:
+            if (emit(d, SAVE, 2 * n->n, 0) < 0 || compile_node(d, nodes, n->a) < 0) return -1;
+            return emit(d, SAVE, 2 * n->n + 1, 0) < 0 ? -1 : 0;
+        case N_BOL:
+            return emit(d, BOL, 0, 0) < 0 ? -1 : 0;
+        case N_EOL:
+            return emit(d, EOL, 0, 0) < 0 ? -1 : 0;
+        case N_REP: {
+            for (int i = 0; i < n->min; i++) {
+                if (compile_node(d, nodes, n->a) < 0) return -1;
+            }
+            if (n->max < 0) {
+                // L: SPLIT L+1, out; <a>; JMP L
+                if ((split = emit(d, SPLIT, 0, 0)) < 0) return -1;
+                d->prog[split].x = d->nprog;
+                if (gen_iteration(d, nodes, node) < 0 || emit(d, JMP, split, 0) < 0) return -1;
+                d->prog[split].y = d->nprog;
+                return 0;
+            }
+            // Each optional copy may be skipped to the end: chain the
+            // SPLITs through their y fields and patch them at the end
+            int chain = -1;
+            for (int i = n->min; i < n->max; i++) {
+                if ((split = emit(d, SPLIT, 0, chain)) < 0) return -1;
+                d->prog[split].x = d->nprog;
+                chain = split;
+                if (gen_iteration(d, nodes, node) < 0) return -1;
+            }
+            while (chain >= 0) {
+                int next = d->prog[chain].y;
+                d->prog[chain].y = d->nprog;
+                chain = next;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// --- Lazy DFA ---
+
+// Follow the program from the pcs on d->stack (count `top`) to the
+// instructions that consume input or end the match, into d->work. BOL is
+// passed only when `bol`, EOL only when `eol` (otherwise it is kept).
+static int closure(struct dfa *d, int top, int bol, int eol) {
+    int n = 0;
+
+    if (++d->gen == 0) {
+        memset(d->mark, 0, (size_t)d->nprog * sizeof(*d->mark));
+        d->gen = 1;
+    }
+    while (top > 0) {
+        int pc = d->stack[--top];
+        if (d->mark[pc] == d->gen) continue;
+        d->mark[pc] = d->gen;
+        const struct inst *in = &d->prog[pc];
+        switch (in->op) {
+            case SPLIT:
+                d->stack[top++] = in->y;
+                d->stack[top++] = in->x;
+                break;
+            case JMP:
+                d->stack[top++] = in->x;
+                break;
+            case SAVE: case MARK: case CHECK:
+                d->stack[top++] = pc + 1;
+                break;
+            case BOL:
+                if (bol) d->stack[top++] = pc + 1;
+                break;
+            case EOL:
+                if (eol) d->stack[top++] = pc + 1;
+                else d->work[n++] = pc;
+                break;
+            default:
+                d->work[n++] = pc;
+                break;
+        }
+    }
+    return n;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static void flush_states(struct dfa *d) {
+    for (int i = 0; i < d->nstates; i++) free(d->states[i].pcs);
+    d->nstates = 0;
+    for (int i = 0; i < d->tablesize; i++) d->table[i] = -1;
+    d->start[0] = d->start[1] = -1;
+}
+
+// The state for the n pcs in d->work, built if new. -1 if the cache is
+// full: the caller flushes it and tries again.
+static int find_state(struct dfa *d, int n) {
+    unsigned h = 2166136261u;
+
+    qsort(d->work, (size_t)n, sizeof(*d->work), cmp_int);
+    for (int i = 0; i < n; i++) h = (h ^ (unsigned)d->work[i]) * 16777619u;
+    int slot = (int)(h & (unsigned)(d->tablesize - 1));
+    for (; d->table[slot] >= 0; slot = (slot + 1) & (d->tablesize - 1)) {
+        const struct dfa_state *s = &d->states[d->table[slot]];
+        if (s->hash == h && s->n == n && memcmp(s->pcs, d->work, (size_t)n * sizeof(int)) == 0)
+            return d->table[slot];
+    }
+    if (d->nstates == MAX_STATES) return -1;
+
+    struct dfa_state *s = &d->states[d->nstates];
+    s->pcs = xmalloc((size_t)n * sizeof(int));
+    memcpy(s->pcs, d->work, (size_t)n * sizeof(int));
+    s->n = n;
+    s->hash = h;
+    s->match = 0;
+    s->eol = -1;
+    for (int i = 0; i < n; i++) {
+        const struct inst *in = &d->prog[s->pcs[i]];
+        if (in->op == MATCH && (s->match == 0 || in->x < s->match - 1)) s->match = in->x + 1;
+    }
+    for (int c = 0; c < 256; c++) d->trans[d->nstates * 256 + c] = -1;
+    d->accept[d->nstates] = s->match != 0;
+    d->table[slot] = d->nstates;
+    return d->nstates++;
+}
+
+static int start_state(struct dfa *d, int bol) {
+    if (d->start[bol] < 0) {
+        d->stack[0] = 0;
+        int n = closure(d, 1, bol, 0);
+        if ((d->start[bol] = find_state(d, n)) < 0) {
+            flush_states(d);
+            d->stack[0] = 0;
+            n = closure(d, 1, bol, 0);
+            d->start[bol] = find_state(d, n);
+        }
+    }
+    return d->start[bol];
+}
+
+// Every match may start at any position: the next state is the step over
+// `c` plus the start of the program.
+static int next_state(struct dfa *d, int state, unsigned char c) {
+    int top = 0;
+    const struct dfa_state *s = &d->states[state];
+
+    for (int i = 0; i < s->n; i++) {
+        const struct inst *in = &d->prog[s->pcs[i]];
+        if (in->op == CHAR && in_set(&d->sets[in->x], c)) d->stack[top++] = s->pcs[i] + 1;
+    }
+    d->stack[top++] = 0;
+    int n = closure(d, top, 0, 0);
+    int next = find_state(d, n);
+    if (next < 0) {
+        flush_states(d);       // d->work still holds the set
+        return find_state(d, n);
+    }
+    d->trans[state * 256 + c] = next;
+    return next;
+}
+
+// Like dfa_state.match, at the end of the line.
+static int eol_match(struct dfa *d, int state, int bol) {
+    struct dfa_state *s = &d->states[state];
+
+    if (s->eol >= 0 && !bol) return s->eol;
+    int top = 0;
+    for (int i = 0; i < s->n; i++) d->stack[top++] = s->pcs[i];
+    int n = closure(d, top, bol, 1), match = 0;
+    for (int i = 0; i < n; i++) {
+        const struct inst *in = &d->prog[d->work[i]];
+        if (in->op == MATCH && (match == 0 || in->x < match - 1)) match = in->x + 1;
+    }
+    if (!bol) s->eol = match;
+    return match;
+}
+
+// The first position in [i, len) holding a byte that can begin a match.
+static size_t skip_to_first(const struct dfa *d, const unsigned char *line, size_t i, size_t len) {
+    if (d->first_byte >= 0) {
+        const unsigned char *hit = memchr(line + i, d->first_byte, len - i);
+        return hit ? (size_t)(hit - line) : len;
+    }
+    while (i < len && !d->first[line[i]]) i++;
+    return i;
+}
+
+// Whether line[pos, len) holds a match.
+static int dfa_search(struct dfa *d, const unsigned char *line, size_t len, size_t pos) {
+    int state = start_state(d, pos == 0);
+    const int *trans = d->trans;
+    const unsigned char *accept = d->accept;
+
+    for (size_t i = pos; i < len; i++) {
+        if (accept[state]) return 1;
+        if (d->skip && state == d->start[0]) {
+            // Nothing under way: on to the next byte that can begin a match
+            i = skip_to_first(d, line, i, len);
+            if (i == len) break;
+        }
+        int next = trans[state * 256 + line[i]];
+        state = next >= 0 ? next : next_state(d, state, line[i]);
+    }
+    return accept[state] || eol_match(d, state, len == 0);
+}
+
+// The lowest pattern of a set that matches in line[0, len), or n if none.
+// Unlike dfa_search() the whole line is scanned unless pattern 0 matches.
+static size_t first_pattern(struct dfa *d, const unsigned char *line, size_t len, size_t n) {
+    int state = start_state(d, 1);
+    const int *trans = d->trans;
+    const unsigned char *accept = d->accept;
+    size_t best = n;
+
+    for (size_t i = 0; i < len; i++) {
+        if (accept[state] && (size_t)d->states[state].match - 1 < best) {
+            if ((best = (size_t)d->states[state].match - 1) == 0) return 0;
+        }
+        if (d->skip && state == d->start[0]) {
+            i = skip_to_first(d, line, i, len);
+            if (i == len) break;
+        }
+        int next = trans[state * 256 + line[i]];
+        state = next >= 0 ? next : next_state(d, state, line[i]);
+    }
+    int m = eol_match(d, state, len == 0);
+    return m > 0 && (size_t)m - 1 < best ? (size_t)m - 1 : best;
+}
+
+// --- Pike VM ---
+
+struct vm {
+    struct dfa *d;
+    const unsigned char *line;
+    size_t len;
+};
+
+// Add the thread at `pc` with captures `caps`, and everything it reaches
+// without consuming input, to list l in priority order.
+static void add_thread(struct vm *vm, int l, int pc, size_t *caps, size_t p) {
+    struct dfa *d = vm->d;
+    const struct inst *in = &d->prog[pc];
+    int i = d->sparse[l][pc];
+
+    if (i < d->n[l] && d->dense[l][i] == pc) return;
+    // An empty iteration dies without claiming the CHECK for the threads
+    // that do get there after consuming input
+    if (in->op == CHECK && caps[in->x] == p) return;
+    d->sparse[l][pc] = d->n[l];
+    d->dense[l][d->n[l]] = pc;
+    size_t *slot = d->caps[l] + (size_t)d->n[l]++ * NSLOT;
+
+    switch (in->op) {
+        case SPLIT:
+            add_thread(vm, l, in->x, caps, p);
+            add_thread(vm, l, in->y, caps, p);
+            break;
+        case JMP:
+            add_thread(vm, l, in->x, caps, p);
+            break;
+        case SAVE: case MARK:
+            if (in->x < d->ncap || in->op == MARK) {
+                size_t old = caps[in->x];
+                caps[in->x] = p;
+                add_thread(vm, l, pc + 1, caps, p);
+                caps[in->x] = old;
+            } else {
+                add_thread(vm, l, pc + 1, caps, p);
+            }
+            break;
+        case BOL:
+            if (p == 0) add_thread(vm, l, pc + 1, caps, p);
+            break;
+        case EOL:
+            if (p == vm->len) add_thread(vm, l, pc + 1, caps, p);
+            break;
+        case CHECK:
+            add_thread(vm, l, pc + 1, caps, p);
+            break;
+        default:
+            memcpy(slot, caps, NSLOT * sizeof(*caps));
+            break;
+    }
+}
+
+static int pike(struct dfa *d, const unsigned char *line, size_t len, size_t pos,
+                regmatch_t pmatch[MAX_GROUPS]) {
+    struct vm vm = { d, line, len };
+    size_t caps[NSLOT], best[NSLOT];
+    int cur = 0, matched = 0;
+
+    d->n[0] = d->n[1] = 0;
+    for (size_t p = pos; ; p++) {
+        if (!matched && d->n[cur] == 0 && d->skip && p > 0) p = skip_to_first(d, line, p, len);
+        if (!matched) {
+            for (int i = 0; i < NSLOT; i++) caps[i] = UNSET;
+            add_thread(&vm, cur, 0, caps, p);
+        }
+        if (d->n[cur] == 0) break;
+
+        int nxt = 1 - cur;
+        d->n[nxt] = 0;
+        for (int i = 0; i < d->n[cur]; i++) {
+            const struct inst *in = &d->prog[d->dense[cur][i]];
+            size_t *tcaps = d->caps[cur] + (size_t)i * NSLOT;
+            if (in->op != CHAR && in->op != MATCH) continue;
+            if (matched && tcaps[0] > best[0]) continue; // a later start: not leftmost
+            if (in->op == MATCH) {
+                // Threads of an earlier start still running may yet match
+                // and then win; of one start, the first to get furthest wins
+                if (!matched || tcaps[0] < best[0] || p > best[1]) {
+                    memcpy(best, tcaps, (size_t)d->ncap * sizeof(*best));
+                    best[1] = p;
+                    matched = 1;
+                }
+            } else if (p < len && in_set(&d->sets[in->x], line[p])) {
+                add_thread(&vm, nxt, d->dense[cur][i] + 1, tcaps, p + 1);
+            }
+        }
+        cur = nxt;
+        if (p == len) break;
+    }
+    if (!matched) return REG_NOMATCH;
+    for (int g = 0; g < MAX_GROUPS; g++) {
+        int ok = 2 * g < d->ncap && best[2 * g] != UNSET && best[2 * g + 1] != UNSET;
+        pmatch[g].rm_so = ok ? (regoff_t)best[2 * g] : -1;
+        pmatch[g].rm_eo = ok ? (regoff_t)best[2 * g + 1] : -1;
+    }
+    return 0;
+}
+
+// --- Backend ---
+
+static void free_dfa(struct dfa *d) {
+    flush_states(d);
+    free(d->prog);
+    free(d->sets);
+    free(d->states);
+    free(d->trans);
+    free(d->accept);
+    free(d->table);
+    free(d->stack);
+    free(d->work);
+    free(d->mark);
+    for (int l = 0; l < 2; l++) {
+        free(d->dense[l]);
+        free(d->sparse[l]);
+        free(d->caps[l]);
+    }
+    free(d);
+}
+
+static void dfa_free(struct matcher *m) {
+    if (m->impl != NULL) free_dfa(m->impl);
+    m->impl = NULL;
+}
+
+// The tables for the compiled program, and the first bytes.
+static void setup(struct dfa *d) {
+    size_t n = (size_t)d->nprog;
+    d->states = xmalloc(MAX_STATES * sizeof(*d->states));
+    d->trans = xmalloc((size_t)MAX_STATES * 256 * sizeof(*d->trans));
+    d->accept = xmalloc(MAX_STATES);
+    d->tablesize = 2 * MAX_STATES;
+    d->table = xmalloc((size_t)d->tablesize * sizeof(*d->table));
+    d->stack = xmalloc((3 * n + 1) * sizeof(*d->stack)); // a state's pcs, then two per SPLIT
+    d->work = xmalloc(n * sizeof(*d->work));
+    d->mark = xmalloc(n * sizeof(*d->mark));
+    memset(d->mark, 0, n * sizeof(*d->mark));
+    for (int l = 0; l < 2 && !d->search_only; l++) {
+        d->dense[l] = xmalloc(n * sizeof(*d->dense[l]));
+        d->sparse[l] = xmalloc(n * sizeof(*d->sparse[l]));
+        d->caps[l] = xmalloc(n * NSLOT * sizeof(*d->caps[l]));
+        memset(d->sparse[l], 0, n * sizeof(*d->sparse[l]));
+    }
+    d->nstates = 0;
+    flush_states(d);
+
+    // The first bytes: what the start state (after position 0) consumes
+    const struct dfa_state *s0 = &d->states[start_state(d, 0)];
+    int nfirst = 0;
+    d->skip = !s0->match;
+    d->first_byte = -1;
+    for (int c = 0; c < 256; c++) {
+        for (int i = 0; i < s0->n && !d->first[c]; i++) {
+            const struct inst *in = &d->prog[s0->pcs[i]];
+            if (in->op == CHAR && in_set(&d->sets[in->x], (unsigned char)c)) d->first[c] = 1;
+        }
+        if (d->first[c]) d->first_byte = nfirst++ ? -1 : c;
+    }
+}
+
+static int dfa_compile(struct matcher *m, const char *pattern) {
+    struct parser ps = { .p = pattern };
+    struct dfa *d = xmalloc(sizeof(*d));
+
+    memset(d, 0, sizeof(*d));
+    m->impl = d;
+    int root = parse_alt(&ps);
+    if (*ps.p != '\0') ps.unsupported = 1; // an unmatched ')', taken literally by glibc
+    if (!ps.unsupported) {
+        // SAVE 0, the pattern, SAVE 1, MATCH
+        root = new_node(&ps, N_GROUP, root, -1);
+        ps.nodes[root].n = 0;
+        if (compile_node(d, ps.nodes, root) < 0 || emit(d, MATCH, 0, 0) < 0) ps.unsupported = 1;
+    }
+    free(ps.nodes);
+    d->sets = ps.sets;
+    if (ps.unsupported) {
+        dfa_free(m);
+        return -1;
+    }
+    d->ncap = 2 * (ps.groups + 1) < NCAP ? 2 * (ps.groups + 1) : NCAP;
+    setup(d);
+    return 0;
+}
+
+static int dfa_exec(const struct matcher *m, const char *line, size_t len, size_t pos,
+                    regmatch_t pmatch[MAX_GROUPS]) {
+    struct dfa *d = m->impl;
+    const unsigned char *s = (const unsigned char *)line;
+
+    if (!dfa_search(d, s, len, pos)) return REG_NOMATCH;
+    return pike(d, s, len, pos, pmatch);
+}
+
+const struct match_backend match_dfa = {
+    "dfa", dfa_compile, dfa_exec, dfa_free
+};
+
+// --- Pattern sets ---
+
+struct pattern_set {
+    struct dfa *d;
+    size_t n;
+};
+
+struct pattern_set *pattern_set_new(const char *const *patterns, size_t n) {
+    struct parser ps = { 0 };
+    struct dfa *d = xmalloc(sizeof(*d));
+    size_t ok = 0;
+
+    memset(d, 0, sizeof(*d));
+    d->search_only = 1;
+    // Each pattern but the last behind a SPLIT to it or on to the next one
+    for (size_t i = 0; i < n; i++) {
+        int split = -1;
+        ps.p = patterns[i];
+        int root = parse_alt(&ps);
+        if (*ps.p != '\0' || ps.unsupported) break;
+        if (i + 1 < n) {
+            if ((split = emit(d, SPLIT, 0, 0)) < 0) break;
+            d->prog[split].x = d->nprog;
+        }
+        if (compile_node(d, ps.nodes, root) < 0 || emit(d, MATCH, (int)i, 0) < 0) break;
+        if (split >= 0) d->prog[split].y = d->nprog;
+        ok++;
+    }
+    free(ps.nodes);
+    d->sets = ps.sets;
+    if (n == 0 || ok < n) {
+        free_dfa(d);
+        return NULL;
+    }
+    setup(d);
+
+    struct pattern_set *s = xmalloc(sizeof(*s));
+    s->d = d;
+    s->n = n;
+    return s;
+}
+
+size_t pattern_set_first(struct pattern_set *s, const char *line, size_t len) {
+    return first_pattern(s->d, (const unsigned char *)line, len, s->n);
+}
+
+void pattern_set_free(struct pattern_set *s) {
+    if (s == NULL) return;
+    free_dfa(s->d);
+    free(s);
+}
@@ -1,6 +1,18 @@
 // esub.c — LinuxApplicationDevelopment2025 / 05_Regexps
-// Implements: esub REGEXP SUBSTITUTION STRING
+// Implements: esub [-g] [-m MATCHER] [-j JOBS] REGEXP SUBSTITUTION [STRING]
+//             esub [-g] [-m MATCHER] [-j JOBS] -F REGEXP SUBSTITUTION FILE...
+//             esub [-g] [-m MATCHER] -i REGEXP SUBSTITUTION FILE...
+//             (or -f SCRIPT in place of REGEXP SUBSTITUTION)
 // Behavior: like `echo "STRING" | sed -E 's/REGEXP/SUBSTITUTION/'` (single replacement).
+// Without STRING, stdin is filtered line by line like `sed -E 's/REGEXP/SUBSTITUTION/'`;
+// -g replaces every match instead of the first one; -m picks the regex
+// engine (dfa or posix, see match.h) instead of the best one for REGEXP.
+// -F reads the FILEs ("-" for stdin) in turn instead of taking a STRING;
+// -j rewrites stdin or the files on JOBS threads (0: one per CPU).
+// -i rewrites each FILE in place instead of printing it (see inplace.h).
+// -f reads the rules from SCRIPT, one s/REGEXP/SUBSTITUTION/[g] per line,
+// and applies them in turn to each line like `sed -E -f SCRIPT`.
+// -s prints statistics as JSON on stderr at exit (see stats.h).
 // Requirements satisfied:
 //  - Extended regex (REG_EXTENDED)
 //  - Diagnostics for invalid regex via regerror
@@ -10,168 +22,251 @@
 //  - Prints original string when no match (like sed single substitution)
 //  - Robust error checking
 //
-// Build: cc -O2 -Wall -Wextra -std=c11 -pedantic -o esub esub.c
+// Build: cc -O2 -Wall -Wextra -std=c11 -pedantic -pthread -o esub esub.c subst.c match.c dfa.c parallel.c inplace.c stats.c
 // Usage: ./esub '([0-9]+)' 'X\\1Y' 'abc123def'   => abcX123Ydef
+//        some-producer | ./esub -g 'secret=[^ ]*' 'secret=***'
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <regex.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#define MAX_GROUPS 10          // 0..9 (0 = whole match, 1..9 = up to 9 capture groups)
-#define MAX_REF_OCCURRENCES 100
+#include "inplace.h"
+#include "parallel.h"
+#include "subst.h"
+
+#define IO_BLOCK (1u << 20)    // stdin is read, and output flushed, in blocks of this size
+#define MAX_JOBS 256
 
 static void die_usage(const char *prog) {
     fprintf(stderr,
-            "Usage: %s REGEXP SUBSTITUTION STRING\n"
-            "       (single replacement, extended regex)\n",
-            prog);
-    exit(2);
-}
-
-static void regerror_die(int code, const regex_t *re, const char *where) {
-    char buf[256];
-    regerror(code, re, buf, sizeof(buf));
-    if (where && *where)
-        fprintf(stderr, "esub: %s: %s\n", where, buf);
-    else
-        fprintf(stderr, "esub: %s\n", buf);
+            "Usage: %s [-gs] [-m dfa|posix] [-j JOBS] REGEXP SUBSTITUTION [STRING]\n"
+            "       %s [-gs] [-m dfa|posix] [-j JOBS] -F REGEXP SUBSTITUTION FILE...\n"
+            "       %s [-gs] [-m dfa|posix] -i REGEXP SUBSTITUTION FILE...\n"
+            "       (extended regex; first match per line, every match with -g;\n"
+            "        reads stdin line by line when STRING is omitted, or the\n"
+            "        FILEs with -F; -j splits the input across JOBS threads;\n"
+            "        -i rewrites the FILEs in place; -f SCRIPT takes the place\n"
+            "        of REGEXP SUBSTITUTION with s/REGEXP/SUBSTITUTION/[g] lines;\n"
+            "        -s reports counts and timings as JSON on stderr)\n",
+            prog, prog, prog);
     exit(2);
 }
 
-struct sbuf {
-    char *data;
-    size_t len;
-    size_t cap;
-};
+// Filter `fd` to stdout in IO_BLOCK reads, writing each block's output at
+// once. A line longer than the buffer grows it; otherwise the unfinished
+// last line moves to the front. Returns 1 if the last line had no newline.
+static int substitute_stream(const struct esub *e, int fd, struct sbuf *out) {
+    struct sbuf in;
+    size_t used = 0;
+    ssize_t r;
+    char last = '\n';
 
-static void sbuf_init(struct sbuf *b) {
-    b->data = NULL;
-    b->len = 0;
-    b->cap = 0;
+    sbuf_init(&in);
+    sbuf_reserve(&in, IO_BLOCK);
+    for (;;) {
+        if (in.cap - used - 1 < IO_BLOCK / 2) {
+            in.len = used;
+            sbuf_reserve(&in, IO_BLOCK);
+        }
+        double t = stats_start(e->stats);
+        r = read(fd, in.data + used, in.cap - used - 1);
+        stats_io(e->stats, t);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "esub: read error: %s\n", strerror(errno));
+            exit(2);
+        }
+        used += (size_t)r;
+        if (r > 0) last = in.data[used - 1];
+        size_t taken = substitute_lines(e, in.data, used, r == 0, out);
+        memmove(in.data, in.data + taken, used - taken);
+        used -= taken;
+        // One output buffer serves the whole stream
+        t = stats_start(e->stats);
+        write_all(STDOUT_FILENO, out->data, out->len);
+        stats_io(e->stats, t);
+        out->len = 0;
+        if (r == 0) break;
+    }
+    free(in.data);
+    return last != '\n';
 }
 
-static void sbuf_reserve(struct sbuf *b, size_t add) {
-    if (b->len + add + 1 <= b->cap) return;
-    size_t ncap = b->cap ? b->cap : 64;
-    while (ncap < b->len + add + 1) ncap *= 2;
-    char *nd = realloc(b->data, ncap);
-    if (!nd) {
-        fprintf(stderr, "esub: out of memory\n");
-        exit(2);
+// One field of an s command, up to the unescaped delimiter; a backslash
+// before the delimiter makes it literal and is dropped. NULL if unterminated.
+static char *script_field(char *p, char delim, char *dst) {
+    for (; *p != '\0'; p++) {
+        if (*p == delim) {
+            *dst = '\0';
+            return p + 1;
+        }
+        if (*p == '\\' && p[1] != '\0') {
+            if (p[1] != delim) *dst++ = '\\';
+            p++;
+        }
+        *dst++ = *p;
     }
-    b->data = nd;
-    b->cap = ncap;
+    return NULL;
 }
 
-static void sbuf_append_mem(struct sbuf *b, const char *s, size_t n) {
-    if (n == 0) return;
-    sbuf_reserve(b, n);
-    memcpy(b->data + b->len, s, n);
-    b->len += n;
-    b->data[b->len] = '\0';
-}
+// The rules of SCRIPT: s/REGEXP/SUBSTITUTION/ or .../g per line, any byte
+// in place of '/', and blank lines and #-comments skipped. Rules without g
+// get `global`.
+static struct rule_spec *read_script(const char *path, int global, size_t *n) {
+    FILE *f = fopen(path, "r");
+    struct rule_spec *rules = NULL;
+    size_t cap = 0, lineno = 0;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
 
-static void sbuf_append_char(struct sbuf *b, char c) {
-    sbuf_reserve(b, 1);
-    b->data[b->len++] = c;
-    b->data[b->len] = '\0';
-}
+    if (f == NULL) {
+        fprintf(stderr, "esub: %s: %s\n", path, strerror(errno));
+        exit(2);
+    }
+    *n = 0;
+    while ((len = getline(&line, &size, f)) >= 0) {
+        lineno++;
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        char *p = line + strspn(line, " \t");
+        if (*p == '\0' || *p == '#') continue;
 
-static void expand_substitution(
-    const char *sub, const char *src,
-    const regmatch_t pmatch[MAX_GROUPS],
-    size_t groups_in_regex, // re->re_nsub
-    struct sbuf *out
-) {
-    size_t ref_count = 0;
-    for (size_t i = 0; sub[i] != '\0'; ++i) {
-        if (sub[i] != '\\') {
-            sbuf_append_char(out, sub[i]);
-            continue;
-        }
-        // sub[i] is backslash, look ahead
-        char next = sub[i+1];
-        if (next == '\0') {
-            // Trailing backslash -> literal backslash
-            sbuf_append_char(out, '\\');
-            break;
+        // Both fields end up in one allocation, which rules[i].pattern owns
+        char *buf = xmalloc((size_t)len + 2), *subst = NULL;
+        char delim = p[1];
+        if (p[0] == 's' && delim != '\0' && delim != '\\' && delim != '\n' &&
+            (p = script_field(p + 2, delim, buf)) != NULL) {
+            subst = buf + strlen(buf) + 1;
+            p = script_field(p, delim, subst);
         }
-        if (next == '\\') {
-            // "\\" -> "\"
-            sbuf_append_char(out, '\\');
-            i++; // consume next
-            continue;
+        if (subst == NULL || p == NULL || (*p != '\0' && strcmp(p, "g") != 0)) {
+            fprintf(stderr, "esub: %s:%zu: expected s/REGEXP/SUBSTITUTION/ or s/.../.../g\n",
+                    path, lineno);
+            exit(2);
         }
-        if (next >= '1' && next <= '9') {
-            int idx = next - '0'; // single digit only; \11 == \1 + '1'
-            if ((size_t)idx > groups_in_regex) {
-                fprintf(stderr, "esub: substitution refers to non-existent group \\%d (pattern has %zu group(s))\n",
-                        idx, groups_in_regex);
+        if (*n == cap) {
+            cap = cap ? 2 * cap : 16;
+            rules = realloc(rules, cap * sizeof(*rules));
+            if (rules == NULL) {
+                fprintf(stderr, "esub: out of memory\n");
                 exit(2);
             }
-            if (++ref_count > MAX_REF_OCCURRENCES) {
-                fprintf(stderr, "esub: too many backreference occurrences in substitution (>%d)\n",
-                        MAX_REF_OCCURRENCES);
-                exit(2);
-            }
-            // If the (existing) group didn't participate in the match, it's an empty string.
-            if (pmatch[idx].rm_so >= 0 && pmatch[idx].rm_eo >= pmatch[idx].rm_so) {
-                sbuf_append_mem(out, src + pmatch[idx].rm_so,
-                                     (size_t)(pmatch[idx].rm_eo - pmatch[idx].rm_so));
-            }
-            i++; // consume digit
-            continue;
         }
-        // Unknown escape -> treat as escaping of the next char (drop the backslash).
-        sbuf_append_char(out, next);
-        i++; // consume next
+        rules[*n].pattern = buf;
+        rules[*n].subst = subst;
+        rules[*n].global = global || *p == 'g';
+        (*n)++;
+    }
+    if (ferror(f)) {
+        fprintf(stderr, "esub: %s: read error\n", path);
+        exit(2);
     }
+    free(line);
+    fclose(f);
+    return rules;
 }
 
 int main(int argc, char **argv) {
-    if (argc != 4) {
+    struct esub *e;
+    const char *matcher = NULL, *script = NULL;
+    int global = 0, files = 0, in_place = 0, jobs = 1, stats = 0;
+    double start = stats_now();
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+gm:Fif:j:s")) != -1) {
+        if (opt == 'g') global = 1;
+        else if (opt == 'm') matcher = optarg;
+        else if (opt == 'F') files = 1;
+        else if (opt == 'i') files = in_place = 1;
+        else if (opt == 'f') script = optarg;
+        else if (opt == 's') stats = 1;
+        else if (opt == 'j') {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || n < 0) die_usage(argv[0]);
+            if (n == 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+            jobs = n < 1 ? 1 : n > MAX_JOBS ? MAX_JOBS : (int)n;
+        } else die_usage(argv[0]);
+    }
+    // REGEXP SUBSTITUTION, unless a script has the rules
+    int nrule_args = script ? 0 : 2;
+    int nargs = argc - optind - nrule_args;
+    if (files ? nargs < 1 : nargs != 0 && nargs != 1) {
         die_usage(argv[0]);
     }
-    const char *pattern = argv[1];
-    const char *subst   = argv[2];
-    const char *input   = argv[3];
-
-    regex_t re;
-    int ccode = regcomp(&re, pattern, REG_EXTENDED);
-    if (ccode != 0) {
-        regerror_die(ccode, &re, "regcomp");
+    struct rule_spec one, *rules = &one;
+    size_t nrules = 1;
+    if (script != NULL) {
+        rules = read_script(script, global, &nrules);
+    } else {
+        one.pattern = argv[optind];
+        one.subst = argv[optind + 1];
+        one.global = global;
     }
+    char **args = argv + optind + nrule_args;
+    const char *input = !files && nargs == 1 ? args[0] : NULL;
 
-    regmatch_t pmatch[MAX_GROUPS];
-    int ecode = regexec(&re, input, MAX_GROUPS, pmatch, 0);
-    if (ecode == REG_NOMATCH) {
-        // No match -> print the original string unchanged (sed behavior)
-        puts(input);
-        regfree(&re);
-        return 0;
-    } else if (ecode != 0) {
-        regerror_die(ecode, &re, "regexec");
+    // One compiled pattern per thread: matchers keep per-search state
+    e = xmalloc((size_t)jobs * sizeof(*e));
+    for (int i = 0; i < jobs; i++) {
+        esub_init_rules(&e[i], rules, nrules, matcher);
+        if (stats) esub_count(&e[i]);
     }
 
-    // Build: prefix + expanded_subst + suffix
     struct sbuf out; sbuf_init(&out);
-    // prefix
-    if (pmatch[0].rm_so > 0) {
-        sbuf_append_mem(&out, input, (size_t)pmatch[0].rm_so);
-    }
-    // expanded substitution
-    expand_substitution(subst, input, pmatch, re.re_nsub, &out);
-    // suffix
-    if (pmatch[0].rm_eo >= 0) {
-        size_t tail = strlen(input) - (size_t)pmatch[0].rm_eo;
-        sbuf_append_mem(&out, input + pmatch[0].rm_eo, tail);
+    if (in_place) {
+        for (int i = 0; i < nargs; i++) substitute_in_place(e, args[i]);
+    } else if (input != NULL) {
+        // Like echo: STRING and a newline, so one line, or several if it
+        // contains newlines; an empty STRING, or what follows its last
+        // newline, is a line too
+        size_t len = strlen(input);
+        char *lines = xmalloc(len + 1);
+        memcpy(lines, input, len);
+        lines[len] = '\n';
+        substitute_lines(e, lines, len + 1, 1, &out);
+        free(lines);
+        write_all(STDOUT_FILENO, out.data, out.len);
+    } else {
+        char *stdin_only[] = { "-" };
+        char **names = files ? args : stdin_only;
+        int count = files ? nargs : 1;
+        for (int i = 0; i < count; i++) {
+            int fd = strcmp(names[i], "-") == 0 ? STDIN_FILENO : open(names[i], O_RDONLY);
+            if (fd < 0) {
+                fprintf(stderr, "esub: %s: %s\n", names[i], strerror(errno));
+                exit(2);
+            }
+            int unterminated = jobs > 1 ? substitute_parallel(e, jobs, fd, STDOUT_FILENO)
+                                        : substitute_stream(e, fd, &out);
+            // Like sed, a file's last line is not run into the next file
+            if (unterminated && i + 1 < count) write_all(STDOUT_FILENO, "\n", 1);
+            if (fd != STDIN_FILENO) close(fd);
+        }
     }
-    puts(out.data ? out.data : "");
 
+    if (stats) {
+        const char **patterns = xmalloc(nrules * sizeof(*patterns));
+        const char **substs = xmalloc(nrules * sizeof(*substs));
+        for (size_t i = 0; i < nrules; i++) {
+            patterns[i] = rules[i].pattern;
+            substs[i] = rules[i].subst;
+        }
+        for (int i = 1; i < jobs; i++) stats_merge(e[0].stats, e[i].stats);
+        stats_print_json(stderr, e[0].stats, patterns, substs, stats_now() - start);
+        free(patterns);
+        free(substs);
+    }
     free(out.data);
-    regfree(&re);
+    for (int i = 0; i < jobs; i++) esub_free(&e[i]);
+    free(e);
+    if (script != NULL) {
+        for (size_t i = 0; i < nrules; i++) free((char *)rules[i].pattern);
+        free(rules);
+    }
     return 0;
 }
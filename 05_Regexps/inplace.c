@@ -0,0 +1,172 @@
+#define _GNU_SOURCE            // copy_file_range(), memrchr()
+#include "inplace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define WRITE_BLOCK (1u << 20)   // rewritten lines are written in blocks of this size
+#define SMALL_SPAN (64u << 10)   // unchanged spans shorter than this are buffered, not copied
+
+struct rewrite {
+    const char *path;
+    char *tmp;                 // the temporary file, removed on errors
+    int in, out;
+    const char *map;
+    size_t size;
+    struct sbuf buf;           // output not written yet
+    struct esub_stats *st;
+};
+
+static void fail(const struct rewrite *rw, const char *what) {
+    int err = errno;
+    if (rw->tmp != NULL) unlink(rw->tmp);
+    if (what != NULL)
+        fprintf(stderr, "esub: %s: %s: %s\n", rw->path, what, strerror(err));
+    else
+        fprintf(stderr, "esub: %s: %s\n", rw->path, strerror(err));
+    exit(2);
+}
+
+static void flush(struct rewrite *rw) {
+    const char *p = rw->buf.data;
+    size_t n = rw->buf.len;
+    double t = stats_start(rw->st);
+
+    if (rw->st != NULL) rw->st->bytes_out += n;
+    while (n > 0) {
+        ssize_t w = write(rw->out, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            fail(rw, "write error");
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    rw->buf.len = 0;
+    stats_io(rw->st, t);
+}
+
+// Copy [from, to) of the input to the output without bringing it into user
+// space, or through the mapping where the kernel cannot do that
+static void copy_span(struct rewrite *rw, size_t from, size_t to) {
+    loff_t off = (loff_t)from;
+    double t = stats_start(rw->st);
+
+    while ((size_t)off < to) {
+        ssize_t n = copy_file_range(rw->in, &off, rw->out, NULL, to - (size_t)off, 0);
+        if (n > 0) {
+            if (rw->st != NULL) rw->st->bytes_out += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)
+            fail(rw, "copy_file_range");
+        sbuf_append_mem(&rw->buf, rw->map + off, to - (size_t)off);
+        break;
+    }
+    stats_io(rw->st, t);
+    flush(rw);
+}
+
+static void unchanged(struct rewrite *rw, size_t from, size_t to) {
+    if (to - from < SMALL_SPAN) {
+        sbuf_append_mem(&rw->buf, rw->map + from, to - from);
+    } else {
+        flush(rw);
+        copy_span(rw, from, to);
+    }
+}
+
+// A temporary file next to the original, with its permissions
+static void open_temp(struct rewrite *rw, const struct stat *st) {
+    const char *slash = strrchr(rw->path, '/');
+    size_t dir = slash ? (size_t)(slash - rw->path) + 1 : 0;
+
+    rw->tmp = xmalloc(dir + sizeof(".esubXXXXXX"));
+    memcpy(rw->tmp, rw->path, dir);
+    strcpy(rw->tmp + dir, ".esubXXXXXX");
+    rw->out = mkstemp(rw->tmp);
+    if (rw->out < 0) {
+        free(rw->tmp);
+        rw->tmp = NULL;
+        fail(rw, "cannot create a temporary file");
+    }
+    if (fchown(rw->out, st->st_uid, st->st_gid) != 0) {
+        // Not the owner: the new file is ours, like with sed -i
+    }
+    if (fchmod(rw->out, st->st_mode & 07777) != 0) fail(rw, "fchmod");
+}
+
+// Make the new contents durable, then put them in place of the old ones
+static void commit(struct rewrite *rw) {
+    flush(rw);
+    double t = stats_start(rw->st);
+    if (fsync(rw->out) != 0) fail(rw, "fsync");
+    if (close(rw->out) != 0) fail(rw, "close");
+    if (rename(rw->tmp, rw->path) != 0) fail(rw, "rename");
+    free(rw->tmp);
+    rw->tmp = NULL;
+
+    // The rename itself is durable once the directory is
+    const char *slash = strrchr(rw->path, '/');
+    char *dir = slash ? strndup(rw->path, (size_t)(slash - rw->path) + 1) : NULL;
+    int fd = open(dir ? dir : ".", O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) != 0) fail(rw, "fsync of the directory");
+    close(fd);
+    free(dir);
+    stats_io(rw->st, t);
+}
+
+int substitute_in_place(const struct esub *e, const char *path) {
+    struct rewrite rw = { .path = path, .out = -1, .st = e->stats };
+    struct stat st;
+
+    rw.in = open(path, O_RDONLY);
+    if (rw.in < 0 || fstat(rw.in, &st) != 0) fail(&rw, NULL);
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "esub: %s: not a regular file\n", path);
+        exit(2);
+    }
+    if (st.st_size == 0) {
+        close(rw.in);
+        return 0;
+    }
+    rw.size = (size_t)st.st_size;
+    rw.map = mmap(NULL, rw.size, PROT_READ, MAP_PRIVATE, rw.in, 0);
+    if (rw.map == MAP_FAILED) fail(&rw, "mmap");
+    madvise((void *)rw.map, rw.size, MADV_SEQUENTIAL);
+    if (rw.st != NULL) rw.st->bytes_in += rw.size;
+
+    size_t next = find_matching_line(e, rw.map, rw.size);
+    int changed = next < rw.size;
+    if (changed) {
+        size_t pos = 0;
+        sbuf_init(&rw.buf);
+        open_temp(&rw, &st);
+        for (;;) {
+            unchanged(&rw, pos, next);
+            if (next == rw.size) break;
+
+            const char *nl = memchr(rw.map + next, '\n', rw.size - next);
+            size_t end = nl ? (size_t)(nl - rw.map) : rw.size;
+            substitute_line(e, rw.map + next, end - next, &rw.buf);
+            if (nl) sbuf_append_char(&rw.buf, '\n');
+            if (rw.buf.len >= WRITE_BLOCK) flush(&rw);
+
+            pos = nl ? end + 1 : rw.size;
+            next = pos + find_matching_line(e, rw.map + pos, rw.size - pos);
+        }
+        commit(&rw);
+        free(rw.buf.data);
+    }
+
+    munmap((void *)rw.map, rw.size);
+    close(rw.in);
+    return changed;
+}
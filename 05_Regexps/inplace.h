@@ -0,0 +1,16 @@
+// inplace.h — esub -i: rewrite files in place
+// The file is mapped and its new contents go to a temporary file in the
+// same directory, which is fsync()ed and renamed over the original, so a
+// crash leaves either the old file or the new one. Lines that do not change
+// are copied file to file with copy_file_range() instead of through a
+// buffer; a file where nothing matches is not touched at all.
+#ifndef INPLACE_H
+#define INPLACE_H
+
+#include "subst.h"
+
+// Rewrite `path` with `e`. Returns 1 if the file was replaced, 0 if nothing
+// matched. Exits on errors, removing the temporary file.
+int substitute_in_place(const struct esub *e, const char *path);
+
+#endif
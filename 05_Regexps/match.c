@@ -0,0 +1,59 @@
+#define _GNU_SOURCE            // REG_STARTEND
+#include "match.h"
+#include "subst.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- posix: regexec() on the regex_t every matcher compiles anyway ---
+
+static int posix_compile(struct matcher *m, const char *pattern) {
+    (void)m;
+    (void)pattern;
+    return 0;
+}
+
+static int posix_exec(const struct matcher *m, const char *line, size_t len, size_t pos,
+                      regmatch_t pmatch[MAX_GROUPS]) {
+    pmatch[0].rm_so = (regoff_t)pos;
+    pmatch[0].rm_eo = (regoff_t)len;
+    int ecode = regexec(&m->re, line, MAX_GROUPS, pmatch, REG_STARTEND);
+    if (ecode != 0 && ecode != REG_NOMATCH) regerror_die(ecode, &m->re, "regexec");
+    return ecode;
+}
+
+static void posix_free(struct matcher *m) {
+    (void)m;
+}
+
+const struct match_backend match_posix = {
+    "posix", posix_compile, posix_exec, posix_free
+};
+
+static const struct match_backend *const backends[] = { &match_dfa, &match_posix };
+
+void matcher_init(struct matcher *m, const char *pattern, const char *name) {
+    int ccode = regcomp(&m->re, pattern, REG_EXTENDED);
+    if (ccode != 0) {
+        regerror_die(ccode, &m->re, "regcomp");
+    }
+    m->impl = NULL;
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (name != NULL && strcmp(name, backends[i]->name) != 0) continue;
+        m->backend = backends[i];
+        if (m->backend->compile(m, pattern) == 0) return;
+        if (name != NULL) {
+            fprintf(stderr, "esub: the %s matcher does not support this pattern\n", name);
+            exit(2);
+        }
+    }
+    fprintf(stderr, "esub: unknown matcher '%s' (dfa, posix)\n", name);
+    exit(2);
+}
+
+void matcher_free(struct matcher *m) {
+    m->backend->free(m);
+    regfree(&m->re);
+}
@@ -0,0 +1,62 @@
+// match.h — pluggable regex matchers for esub
+// Every backend implements the same contract as regexec() with REG_STARTEND:
+// find the leftmost-longest match of the ERE in line[pos, len), where `^`
+// and `$` refer to the ends of the whole line, and report the groups that
+// took part (rm_so == -1 for the others).
+//
+//  - posix: glibc regexec(). Handles everything regcomp() accepts, but it
+//    backtracks and can be superlinear on long lines.
+//  - dfa:   a lazily built DFA decides whether the rest of the line matches
+//    at all; only then a Thompson NFA (Pike VM) finds the match and its
+//    groups. Both are linear in the line length. Backreferences and GNU
+//    word anchors are not supported; such patterns stay with posix.
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <regex.h>
+#include <stddef.h>
+
+#define MAX_GROUPS 10          // 0..9 (0 = whole match, 1..9 = up to 9 capture groups)
+
+struct matcher;
+
+struct match_backend {
+    const char *name;
+    // 0 on success, -1 if the pattern needs something the backend lacks.
+    int (*compile)(struct matcher *m, const char *pattern);
+    // 0 on a match, REG_NOMATCH otherwise.
+    int (*exec)(const struct matcher *m, const char *line, size_t len, size_t pos,
+                regmatch_t pmatch[MAX_GROUPS]);
+    void (*free)(struct matcher *m);
+};
+
+struct matcher {
+    const struct match_backend *backend;
+    regex_t re;            // always compiled: validates the pattern, counts groups
+    void *impl;            // backend state
+};
+
+extern const struct match_backend match_posix, match_dfa;
+
+// Compile `pattern` (POSIX ERE) for the backend called `name`, or with NULL
+// for the fastest one that supports it. Exits on errors.
+void matcher_init(struct matcher *m, const char *pattern, const char *name);
+void matcher_free(struct matcher *m);
+
+static inline int matcher_exec(const struct matcher *m, const char *line, size_t len,
+                               size_t pos, regmatch_t pmatch[MAX_GROUPS]) {
+    return m->backend->exec(m, line, len, pos, pmatch);
+}
+
+// Several patterns searched together in one pass over the line, with the
+// dfa matcher's machinery; for esub scripts, where most lines match none of
+// the rules. Only tells which pattern matches, not where.
+struct pattern_set;
+
+// NULL if the dfa matcher does not support one of the patterns.
+struct pattern_set *pattern_set_new(const char *const *patterns, size_t n);
+// The lowest i such that patterns[i] matches in line[0, len), n if none.
+size_t pattern_set_first(struct pattern_set *s, const char *line, size_t len);
+void pattern_set_free(struct pattern_set *s);
+
+#endif
@@ -0,0 +1,210 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Chunks go around a ring of 2 * jobs slots, so every worker has one to
+// rewrite while the writer drains another. A slot is
+//   FREE -> READY (filled by the producer) -> DONE (rewritten) -> FREE (written)
+// and chunk i always lives in slot i % nslots, so the writer only ever
+// waits for the oldest chunk.
+
+enum { FREE, READY, DONE };
+
+struct slot {
+    const char *data;          // the chunk: complete lines, except at EOF
+    size_t len;
+    struct sbuf in;            // read buffer when the input is not mapped
+    struct sbuf out;
+    int state;
+};
+
+struct pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;       // a chunk is READY, or the input ended
+    pthread_cond_t done;       // a chunk is DONE
+    struct slot *slots;
+    size_t nslots;
+    size_t filled;             // chunks handed out so far
+    size_t taken;              // chunks claimed by a worker so far
+    int eof;
+};
+
+struct worker {
+    pthread_t thread;
+    struct pool *pool;
+    const struct esub *e;
+};
+
+static void die_errno(const char *what, int err) {
+    fprintf(stderr, "esub: %s: %s\n", what, strerror(err));
+    exit(2);
+}
+
+static void *work(void *arg) {
+    struct worker *w = arg;
+    struct pool *p = w->pool;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->taken == p->filled && !p->eof) pthread_cond_wait(&p->work, &p->lock);
+        if (p->taken == p->filled) break;
+        struct slot *s = &p->slots[p->taken++ % p->nslots];
+        pthread_mutex_unlock(&p->lock);
+
+        s->out.len = 0;
+        substitute_lines(w->e, s->data, s->len, 1, &s->out);
+
+        pthread_mutex_lock(&p->lock);
+        s->state = DONE;
+        pthread_cond_broadcast(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Where the chunk starting at `off` of a mapped file ends: at the first
+// newline after PAR_CHUNK bytes, or at EOF.
+static size_t chunk_end(const char *map, size_t size, size_t off) {
+    if (size - off <= PAR_CHUNK) return size;
+    const char *nl = memchr(map + off + PAR_CHUNK, '\n', size - off - PAR_CHUNK);
+    return nl ? (size_t)(nl - map) + 1 : size;
+}
+
+// Fill s->in with the `carry` bytes left over by the previous chunk and
+// then at least PAR_CHUNK more bytes of complete lines; returns 0 at EOF
+// with nothing left.
+// The bytes after the last newline are left in place for the next chunk.
+static int read_chunk(int fd, struct slot *s, const char *carry, size_t ncarry, int *eof,
+                      struct esub_stats *st) {
+    s->in.len = 0;
+    sbuf_append_mem(&s->in, carry, ncarry);
+    for (;;) {
+        sbuf_reserve(&s->in, PAR_CHUNK);
+        double t = stats_start(st);
+        ssize_t r = read(fd, s->in.data + s->in.len, s->in.cap - s->in.len - 1);
+        stats_io(st, t);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            die_errno("read error", errno);
+        }
+        s->in.len += (size_t)r;
+        if (r == 0) {
+            *eof = 1;
+            s->data = s->in.data;
+            s->len = s->in.len;
+            return s->len > 0;
+        }
+        if (s->in.len - ncarry < PAR_CHUNK) continue;
+        const char *nl = memrchr(s->in.data, '\n', s->in.len);
+        if (nl == NULL) continue; // one line longer than a chunk
+        s->data = s->in.data;
+        s->len = (size_t)(nl - s->in.data) + 1;
+        return 1;
+    }
+}
+
+int substitute_parallel(const struct esub *workers, int jobs, int in_fd, int out_fd) {
+    struct pool p = { .nslots = 2 * (size_t)jobs };
+    struct worker *w = xmalloc((size_t)jobs * sizeof(*w));
+    struct stat st;
+    const char *map = NULL;
+    size_t size = 0, off = 0, written = 0;
+    int eof = 0, err;
+    char last = '\n';
+    // This thread's reads and writes count with worker 0's stats; the
+    // fields are apart, so worker 0 counting at the same time is no race
+    struct esub_stats *io = workers[0].stats;
+
+    // A file, possibly read partly already (stdin redirected from one)
+    off_t pos = lseek(in_fd, 0, SEEK_CUR);
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && pos >= 0 && st.st_size > pos) {
+        size = (size_t)st.st_size;
+        off = (size_t)pos;
+        map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+        else madvise((void *)map, size, MADV_SEQUENTIAL);
+    }
+
+    p.slots = xmalloc(p.nslots * sizeof(*p.slots));
+    for (size_t i = 0; i < p.nslots; i++) {
+        p.slots[i].state = FREE;
+        sbuf_init(&p.slots[i].in);
+        sbuf_init(&p.slots[i].out);
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.work, NULL);
+    pthread_cond_init(&p.done, NULL);
+    for (int i = 0; i < jobs; i++) {
+        w[i].pool = &p;
+        w[i].e = &workers[i];
+        if ((err = pthread_create(&w[i].thread, NULL, work, &w[i])) != 0)
+            die_errno("pthread_create", err);
+    }
+
+    // Hand out chunks while a slot is free, otherwise write out the oldest
+    for (;;) {
+        if (!eof && p.filled - written < p.nslots) {
+            struct slot *s = &p.slots[p.filled % p.nslots];
+            int more;
+            if (map != NULL) {
+                size_t end = chunk_end(map, size, off);
+                s->data = map + off;
+                s->len = end - off;
+                off = end;
+                more = 1;
+                eof = off == size;
+            } else {
+                // The unfinished line at the end of the previous chunk
+                const struct slot *prev = &p.slots[(p.filled + p.nslots - 1) % p.nslots];
+                const char *carry = p.filled > 0 ? prev->data + prev->len : NULL;
+                size_t ncarry = p.filled > 0 ? prev->in.len - prev->len : 0;
+                more = read_chunk(in_fd, s, carry, ncarry, &eof, io);
+            }
+            pthread_mutex_lock(&p.lock);
+            if (more) {
+                last = s->data[s->len - 1];
+                s->state = READY;
+                p.filled++;
+            }
+            p.eof = eof;
+            pthread_cond_broadcast(&p.work);
+            pthread_mutex_unlock(&p.lock);
+            continue;
+        }
+        if (written == p.filled) break;
+
+        struct slot *s = &p.slots[written % p.nslots];
+        pthread_mutex_lock(&p.lock);
+        while (s->state != DONE) pthread_cond_wait(&p.done, &p.lock);
+        pthread_mutex_unlock(&p.lock);
+        double t = stats_start(io);
+        write_all(out_fd, s->out.data, s->out.len);
+        stats_io(io, t);
+        s->state = FREE;
+        written++;
+    }
+
+    for (int i = 0; i < jobs; i++) pthread_join(w[i].thread, NULL);
+    for (size_t i = 0; i < p.nslots; i++) {
+        free(p.slots[i].in.data);
+        free(p.slots[i].out.data);
+    }
+    free(p.slots);
+    free(w);
+    pthread_cond_destroy(&p.work);
+    pthread_cond_destroy(&p.done);
+    pthread_mutex_destroy(&p.lock);
+    if (map != NULL) {
+        munmap((void *)map, size);
+        lseek(in_fd, (off_t)size, SEEK_SET);
+    }
+    return last != '\n';
+}
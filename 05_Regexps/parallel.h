@@ -0,0 +1,19 @@
+// parallel.h — esub -j: substitution on a pool of worker threads
+// The input is cut at newlines into chunks of about PAR_CHUNK bytes, which
+// the workers rewrite concurrently, each with its own compiled pattern
+// (a regex_t or DFA cache is not shared between threads) and its own
+// output buffer. The calling thread writes the results in input order.
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "subst.h"
+
+#define PAR_CHUNK (4u << 20)
+
+// Rewrite `in_fd` to `out_fd` with jobs workers, workers[i] being
+// initialised for worker i. A regular file is mapped, anything else is read
+// in PAR_CHUNK blocks. Returns 1 if the last line had no newline. Exits on
+// errors.
+int substitute_parallel(const struct esub *workers, int jobs, int in_fd, int out_fd);
+
+#endif
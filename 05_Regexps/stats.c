@@ -0,0 +1,98 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime()
+#include "stats.h"
+#include "subst.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+struct esub_stats *stats_new(size_t nrules) {
+    struct esub_stats *s = xmalloc(sizeof(*s));
+
+    memset(s, 0, sizeof(*s));
+    s->nrules = nrules;
+    s->matches = xmalloc(nrules * sizeof(*s->matches));
+    s->lines = xmalloc(nrules * sizeof(*s->lines));
+    memset(s->matches, 0, nrules * sizeof(*s->matches));
+    memset(s->lines, 0, nrules * sizeof(*s->lines));
+    return s;
+}
+
+void stats_free(struct esub_stats *s) {
+    if (s == NULL) return;
+    free(s->matches);
+    free(s->lines);
+    free(s);
+}
+
+void stats_merge(struct esub_stats *to, const struct esub_stats *from) {
+    for (size_t i = 0; i < to->nrules; i++) {
+        to->matches[i] += from->matches[i];
+        to->lines[i] += from->lines[i];
+    }
+    to->bytes_in += from->bytes_in;
+    to->bytes_out += from->bytes_out;
+    to->match += from->match;
+    to->expand += from->expand;
+    to->io += from->io;
+}
+
+// Length of the well-formed UTF-8 sequence at s (a byte >= 0x80), 0 if
+// it is not one: no overlongs, surrogates or code points past U+10FFFF
+static size_t utf8_len(const unsigned char *s) {
+    size_t n;
+    unsigned char lo = 0x80, hi = 0xbf;
+
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) n = 2;
+    else if (s[0] >= 0xe0 && s[0] <= 0xef) n = 3;
+    else if (s[0] >= 0xf0 && s[0] <= 0xf4) n = 4;
+    else return 0;
+    if (s[0] == 0xe0) lo = 0xa0;
+    else if (s[0] == 0xed) hi = 0x9f;
+    else if (s[0] == 0xf0) lo = 0x90;
+    else if (s[0] == 0xf4) hi = 0x8f;
+    if (s[1] < lo || s[1] > hi) return 0;
+    for (size_t i = 2; i < n; i++)
+        if (s[i] < 0x80 || s[i] > 0xbf) return 0;
+    return n;
+}
+
+// Patterns are bytes: valid UTF-8 is copied, any other byte >= 0x80 is
+// written as the code point of the same value, so the report stays JSON
+static void json_string(FILE *f, const char *s) {
+    putc('"', f);
+    while (*s != '\0') {
+        unsigned char c = (unsigned char)*s;
+        size_t n = c >= 0x80 ? utf8_len((const unsigned char *)s) : 1;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20 || n == 0) fprintf(f, "\\u%04x", c);
+        else fwrite(s, 1, n, f);
+        s += n > 0 ? n : 1;
+    }
+    putc('"', f);
+}
+
+void stats_print_json(FILE *f, const struct esub_stats *s, const char *const *patterns,
+                      const char *const *substs, double wall) {
+    fprintf(f, "{\n  \"rules\": [");
+    for (size_t i = 0; i < s->nrules; i++) {
+        fprintf(f, "%s\n    {\"pattern\": ", i ? "," : "");
+        json_string(f, patterns[i]);
+        fprintf(f, ", \"substitution\": ");
+        json_string(f, substs[i]);
+        fprintf(f, ", \"matches\": %zu, \"lines\": %zu}", s->matches[i], s->lines[i]);
+    }
+    fprintf(f, "%s],\n", s->nrules ? "\n  " : "");
+    fprintf(f, "  \"bytes_scanned\": %zu,\n", s->bytes_in);
+    fprintf(f, "  \"bytes_emitted\": %zu,\n", s->bytes_out);
+    fprintf(f, "  \"sbuf_reallocs\": %zu,\n", sbuf_reallocs());
+    fprintf(f, "  \"seconds\": {\"match\": %.6f, \"expand\": %.6f, \"io\": %.6f, \"wall\": %.6f}\n",
+            s->match, s->expand, s->io, wall);
+    fprintf(f, "}\n");
+}
@@ -0,0 +1,44 @@
+// stats.h — esub -s: where the substitutions happen and where the time goes
+// Each struct esub (one per thread) counts into its own esub_stats, so the
+// hot paths take no lock; the counts are summed at exit and printed as
+// JSON. Counting is off unless enabled: a NULL check per line and per match.
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct esub_stats {
+    size_t nrules;
+    size_t *matches;           // per rule: substitutions made
+    size_t *lines;             // per rule: lines it changed
+    size_t bytes_in;           // input scanned
+    size_t bytes_out;          // output emitted
+    // Seconds, summed over threads: in the matcher (prefilter and copying
+    // unchanged lines included), expanding SUBSTITUTION, and in system
+    // calls that read, write, copy or sync
+    double match, expand, io;
+};
+
+double stats_now(void);        // a monotonic clock, in seconds
+
+struct esub_stats *stats_new(size_t nrules);
+void stats_free(struct esub_stats *s);
+
+// Timing a system call into s->io, if s is not NULL:
+//   double t = stats_start(s); read(...); stats_io(s, t);
+static inline double stats_start(const struct esub_stats *s) {
+    return s != NULL ? stats_now() : 0;
+}
+
+static inline void stats_io(struct esub_stats *s, double start) {
+    if (s != NULL) s->io += stats_now() - start;
+}
+// Add the counts of `from` to `to` (with as many rules).
+void stats_merge(struct esub_stats *to, const struct esub_stats *from);
+// The report: counts, the rules' patterns and substitutions, and `wall`
+// seconds since the start.
+void stats_print_json(FILE *f, const struct esub_stats *s, const char *const *patterns,
+                      const char *const *substs, double wall);
+
+#endif
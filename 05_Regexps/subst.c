@@ -0,0 +1,532 @@
+#define _GNU_SOURCE            // memrchr()
+#include "subst.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void regerror_die(int code, const regex_t *re, const char *where) {
+    char buf[256];
+    regerror(code, re, buf, sizeof(buf));
+    if (where && *where)
+        fprintf(stderr, "esub: %s: %s\n", where, buf);
+    else
+        fprintf(stderr, "esub: %s\n", buf);
+    exit(2);
+}
+
+void sbuf_init(struct sbuf *b) {
+    b->data = NULL;
+    b->len = 0;
+    b->cap = 0;
+}
+
+static atomic_size_t reallocs;
+
+size_t sbuf_reallocs(void) {
+    return atomic_load(&reallocs);
+}
+
+void sbuf_reserve(struct sbuf *b, size_t add) {
+    if (b->len + add + 1 <= b->cap) return;
+    size_t ncap = b->cap ? b->cap : 64;
+    while (ncap < b->len + add + 1) ncap *= 2;
+    char *nd = realloc(b->data, ncap);
+    if (!nd) {
+        fprintf(stderr, "esub: out of memory\n");
+        exit(2);
+    }
+    b->data = nd;
+    b->cap = ncap;
+    atomic_fetch_add_explicit(&reallocs, 1, memory_order_relaxed);
+}
+
+void sbuf_append_mem(struct sbuf *b, const char *s, size_t n) {
+    if (n == 0) return;
+    sbuf_reserve(b, n);
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+void sbuf_append_char(struct sbuf *b, char c) {
+    sbuf_reserve(b, 1);
+    b->data[b->len++] = c;
+    b->data[b->len] = '\0';
+}
+
+void write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "esub: write error: %s\n", strerror(errno));
+            exit(2);
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+void *xmalloc(size_t n) {
+    void *p = malloc(n ? n : 1);
+    if (!p) {
+        fprintf(stderr, "esub: out of memory\n");
+        exit(2);
+    }
+    return p;
+}
+
+static void tmpl_literal(struct template *t, size_t *lit, char c) {
+    if (t->nops == 0 || t->ops[t->nops - 1].group != 0) {
+        t->ops[t->nops].group = 0;
+        t->ops[t->nops].off = *lit;
+        t->ops[t->nops].len = 0;
+        t->nops++;
+    }
+    t->lit[(*lit)++] = c;
+    t->ops[t->nops - 1].len++;
+    t->lit_len++;
+}
+
+// Fails (exit 2) on a reference to a group the pattern does not have,
+// before any input is read.
+static void compile_template(const char *sub, size_t groups_in_regex, struct template *t) {
+    size_t n = strlen(sub), lit = 0, ref_count = 0;
+
+    // Never more ops, nor more literal bytes, than SUBSTITUTION has bytes
+    t->lit = xmalloc(n);
+    t->ops = xmalloc(n * sizeof(*t->ops));
+    t->nops = 0;
+    t->lit_len = 0;
+    for (size_t i = 0; sub[i] != '\0'; ++i) {
+        if (sub[i] != '\\') {
+            tmpl_literal(t, &lit, sub[i]);
+            continue;
+        }
+        // sub[i] is backslash, look ahead
+        char next = sub[i+1];
+        if (next == '\0') {
+            // Trailing backslash -> literal backslash
+            tmpl_literal(t, &lit, '\\');
+            break;
+        }
+        i++; // consume next
+        if (next >= '1' && next <= '9') {
+            int idx = next - '0'; // single digit only; \11 == \1 + '1'
+            if ((size_t)idx > groups_in_regex) {
+                fprintf(stderr, "esub: substitution refers to non-existent group \\%d (pattern has %zu group(s))\n",
+                        idx, groups_in_regex);
+                exit(2);
+            }
+            if (++ref_count > MAX_REF_OCCURRENCES) {
+                fprintf(stderr, "esub: too many backreference occurrences in substitution (>%d)\n",
+                        MAX_REF_OCCURRENCES);
+                exit(2);
+            }
+            t->ops[t->nops].group = idx;
+            t->nops++;
+            continue;
+        }
+        // "\\" -> "\"; unknown escape -> the next char (drop the backslash)
+        tmpl_literal(t, &lit, next);
+    }
+}
+
+static void free_template(struct template *t) {
+    free(t->lit);
+    free(t->ops);
+}
+
+// Append the template applied to the match in `pmatch` (offsets into `src`).
+static void expand_template(const struct template *t, const char *src,
+                            const regmatch_t pmatch[MAX_GROUPS], struct sbuf *out) {
+    size_t total = t->lit_len;
+
+    // A group that didn't participate in the match is an empty string
+    for (size_t i = 0; i < t->nops; i++) {
+        const regmatch_t *m = &pmatch[t->ops[i].group];
+        if (t->ops[i].group != 0 && m->rm_so >= 0 && m->rm_eo > m->rm_so)
+            total += (size_t)(m->rm_eo - m->rm_so);
+    }
+    if (total == 0) return;
+    sbuf_reserve(out, total);
+
+    char *dst = out->data + out->len;
+    for (size_t i = 0; i < t->nops; i++) {
+        const struct tmpl_op *op = &t->ops[i];
+        if (op->group == 0) {
+            memcpy(dst, t->lit + op->off, op->len);
+            dst += op->len;
+        } else if (pmatch[op->group].rm_so >= 0 && pmatch[op->group].rm_eo > pmatch[op->group].rm_so) {
+            size_t len = (size_t)(pmatch[op->group].rm_eo - pmatch[op->group].rm_so);
+            memcpy(dst, src + pmatch[op->group].rm_so, len);
+            dst += len;
+        }
+    }
+    out->len += total;
+    out->data[out->len] = '\0';
+}
+
+// --- Literal prefilter ---
+// The pattern is scanned for literal runs that every match must contain;
+// the longest one becomes the prefilter. The analysis is conservative:
+// groups, bracket expressions, '.', anchors and escapes other than escaped
+// punctuation end a run, an optional atom (*, ?, {0,...}) is left out, and
+// a top-level '|' disables the prefilter altogether.
+
+// Index just past the bracket expression starting at p[i] == '[', or 0.
+static size_t skip_bracket(const char *p, size_t i) {
+    i++;
+    if (p[i] == '^') i++;
+    if (p[i] == ']') i++; // a leading ']' is literal
+    while (p[i] != '\0' && p[i] != ']') {
+        if (p[i] == '[' && (p[i+1] == ':' || p[i+1] == '.' || p[i+1] == '=')) {
+            char kind = p[i+1];
+            i += 2;
+            while (p[i] != '\0' && !(p[i] == kind && p[i+1] == ']')) i++;
+            if (p[i] == '\0') return 0;
+            i += 2;
+        } else {
+            i++;
+        }
+    }
+    return p[i] == ']' ? i + 1 : 0;
+}
+
+// Index just past the group starting at p[i] == '(', or 0.
+static size_t skip_group(const char *p, size_t i) {
+    int depth = 0;
+    while (p[i] != '\0') {
+        if (p[i] == '\\') {
+            if (p[i+1] == '\0') return 0;
+            i += 2;
+        } else if (p[i] == '[') {
+            if ((i = skip_bracket(p, i)) == 0) return 0;
+        } else {
+            if (p[i] == '(') depth++;
+            if (p[i] == ')' && --depth == 0) return i + 1;
+            i++;
+        }
+    }
+    return 0;
+}
+
+// Longest literal every match of `p` contains; sets *len to 0 if none.
+static char *required_literal(const char *p, size_t *len) {
+    size_t n = strlen(p), rlen = 0, blen = 0, i = 0;
+    char *run = xmalloc(n), *best = xmalloc(n);
+
+    while (i < n) {
+        int lit = -1; // the byte this atom matches, if it is a literal
+        char c = p[i];
+        if (c == '\\') {
+            if (i + 1 == n) break;
+            // Only an escaped ERE metacharacter is that byte; other escapes
+            // are GNU operators (\< \> \b \` \' \w ...), not literals
+            if (strchr(".[]()*+?{}|^$\\", p[i+1]) != NULL) lit = (unsigned char)p[i+1];
+            i += 2;
+        } else if (c == '[') {
+            if ((i = skip_bracket(p, i)) == 0) goto none;
+        } else if (c == '(') {
+            if ((i = skip_group(p, i)) == 0) goto none;
+        } else if (c == '|' || c == ')' || c == '*' || c == '+' || c == '?' || c == '{') {
+            goto none; // alternation, or a construct not worth reasoning about
+        } else {
+            if (c != '.' && c != '^' && c != '$' && c != '\n') lit = (unsigned char)c;
+            i++;
+        }
+
+        int optional = 0, repeated = 0;
+        while (i < n && (p[i] == '*' || p[i] == '+' || p[i] == '?' || p[i] == '{')) {
+            if (p[i] == '{') {
+                if (!isdigit((unsigned char)p[i+1])) goto none;
+                if (strtoul(p + i + 1, NULL, 10) == 0) optional = 1; else repeated = 1;
+                const char *close = strchr(p + i, '}');
+                if (close == NULL) goto none;
+                i = (size_t)(close - p) + 1;
+            } else {
+                if (p[i] == '+') repeated = 1; else optional = 1;
+                i++;
+            }
+        }
+
+        if (lit >= 0 && !optional) run[rlen++] = (char)lit;
+        if (lit < 0 || optional || repeated) {
+            if (rlen > blen) {
+                memcpy(best, run, rlen);
+                blen = rlen;
+            }
+            rlen = 0;
+            // "ab+c" requires "ab" and, after the last b, "bc"
+            if (lit >= 0 && repeated && !optional) run[rlen++] = (char)lit;
+        }
+    }
+    if (rlen > blen) {
+        memcpy(best, run, rlen);
+        blen = rlen;
+    }
+    free(run);
+    *len = blen;
+    return best;
+
+none:
+    free(run);
+    *len = 0;
+    return best;
+}
+
+// Rough rarity of a byte in text: lowercase letters and spaces are common,
+// digits and punctuation less so, capitals and non-ASCII bytes rarest.
+static int rarity(unsigned char c) {
+    if (c == ' ' || c == 'e' || c == 't' || c == 'a' || c == 'o') return 0;
+    if (islower(c)) return 1;
+    if (isdigit(c) || ispunct(c)) return 2;
+    if (isupper(c)) return 3;
+    return 4;
+}
+
+// First occurrence of the prefilter literal in p[0, n). memchr() for its
+// rarest byte skips most of the input at vector speed; each candidate is
+// then checked with memcmp().
+static const char *find_literal(const struct rule *r, const char *p, size_t n) {
+    if (n < r->lit_len) return NULL;
+    const char *q = p + r->rare;
+    const char *last = p + n - r->lit_len + r->rare; // last candidate position
+    char c = r->lit[r->rare];
+
+    while (q <= last && (q = memchr(q, c, (size_t)(last - q) + 1)) != NULL) {
+        if (memcmp(q - r->rare, r->lit, r->lit_len) == 0) return q - r->rare;
+        q++;
+    }
+    return NULL;
+}
+
+static void init_rule(struct rule *r, const struct rule_spec *spec, const char *matcher) {
+    matcher_init(&r->m, spec->pattern, matcher);
+    compile_template(spec->subst, r->m.re.re_nsub, &r->subst);
+    r->global = spec->global;
+
+    r->lit = required_literal(spec->pattern, &r->lit_len);
+    r->rare = 0;
+    for (size_t i = 1; i < r->lit_len; i++) {
+        if (rarity((unsigned char)r->lit[i]) > rarity((unsigned char)r->lit[r->rare])) r->rare = i;
+    }
+}
+
+void esub_init_rules(struct esub *e, const struct rule_spec *rules, size_t n,
+                     const char *matcher) {
+    e->rules = xmalloc(n * sizeof(*e->rules));
+    e->nrules = n;
+    for (size_t i = 0; i < n; i++) init_rule(&e->rules[i], &rules[i], matcher);
+
+    // The set scan is the dfa matcher's, and only worth it for several rules
+    e->scan = NULL;
+    if (n > 1 && (matcher == NULL || strcmp(matcher, "dfa") == 0)) {
+        const char **patterns = xmalloc(n * sizeof(*patterns));
+        for (size_t i = 0; i < n; i++) patterns[i] = rules[i].pattern;
+        e->scan = pattern_set_new(patterns, n);
+        free(patterns);
+    }
+    e->tmp = xmalloc(2 * sizeof(*e->tmp));
+    for (int k = 0; k < 2; k++) {
+        sbuf_init(&e->tmp[k]);
+        sbuf_reserve(&e->tmp[k], 64);
+    }
+    e->prefilter = 1;
+    e->stats = NULL;
+}
+
+void esub_init(struct esub *e, const char *pattern, const char *subst, int global,
+               const char *matcher) {
+    struct rule_spec rule = { pattern, subst, global };
+    esub_init_rules(e, &rule, 1, matcher);
+}
+
+void esub_free(struct esub *e) {
+    for (size_t i = 0; i < e->nrules; i++) {
+        free(e->rules[i].lit);
+        free_template(&e->rules[i].subst);
+        matcher_free(&e->rules[i].m);
+    }
+    free(e->rules);
+    pattern_set_free(e->scan);
+    for (int k = 0; k < 2; k++) free(e->tmp[k].data);
+    free(e->tmp);
+    stats_free(e->stats);
+}
+
+void esub_count(struct esub *e) {
+    if (e->stats == NULL) e->stats = stats_new(e->nrules);
+}
+
+// The first rule that matches `line`, or e->nrules.
+static size_t first_rule(const struct esub *e, const char *line, size_t len) {
+    regmatch_t pmatch[MAX_GROUPS];
+
+    if (e->scan != NULL) return pattern_set_first(e->scan, line, len);
+    for (size_t i = 0; i < e->nrules; i++) {
+        const struct rule *r = &e->rules[i];
+        if (e->prefilter && r->lit_len > 0 && find_literal(r, line, len) == NULL) continue;
+        if (matcher_exec(&r->m, line, len, 0, pmatch) == 0) return i;
+    }
+    return e->nrules;
+}
+
+// Returns the number of substitutions made; with `st`, times the expansions.
+static size_t apply_rule(const struct rule *r, const char *line, size_t len, struct sbuf *out,
+                         struct esub_stats *st) {
+    regmatch_t pmatch[MAX_GROUPS];
+    size_t count = 0;
+    size_t pos = 0;   // next byte to search from
+    size_t done = 0;  // input copied to `out` so far
+    size_t prev = 0;  // end of the previous match
+    int matched = 0;
+
+    while (pos <= len) {
+        if (matcher_exec(&r->m, line, len, pos, pmatch) == REG_NOMATCH) break;
+
+        size_t so = (size_t)pmatch[0].rm_so, eo = (size_t)pmatch[0].rm_eo;
+        // Like sed, an empty match right after the previous match is skipped
+        if (so == eo && matched && so == prev) {
+            if (so == len) break;
+            pos = so + 1;
+            continue;
+        }
+        sbuf_append_mem(out, line + done, so - done);
+        if (st != NULL) {
+            double t = stats_now();
+            expand_template(&r->subst, line, pmatch, out);
+            st->expand += stats_now() - t;
+        } else {
+            expand_template(&r->subst, line, pmatch, out);
+        }
+        count++;
+        done = prev = eo;
+        matched = 1;
+        if (!r->global) break;
+        pos = eo > so ? eo : eo + 1;
+        if (so == eo && so < len) {
+            // Step over the character after an empty match
+            sbuf_append_char(out, line[so]);
+            done = so + 1;
+        }
+    }
+    sbuf_append_mem(out, line + done, len - done);
+    return count;
+}
+
+static void apply(const struct esub *e, size_t i, const char *line, size_t len,
+                  struct sbuf *out) {
+    size_t n = apply_rule(&e->rules[i], line, len, out, e->stats);
+    if (e->stats != NULL) {
+        e->stats->matches[i] += n;
+        e->stats->lines[i] += n > 0;
+    }
+}
+
+// Elapsed time since `start` goes to the matcher, but for what went to the
+// expansions meanwhile (which were `expand` seconds before).
+static void count_time(const struct esub *e, double start, double expand) {
+    e->stats->match += stats_now() - start - (e->stats->expand - expand);
+}
+
+static void rewrite_line(const struct esub *e, const char *line, size_t len, struct sbuf *out) {
+    size_t i = e->nrules == 1 ? 0 : first_rule(e, line, len);
+
+    if (i == e->nrules) {
+        sbuf_append_mem(out, line, len);
+        return;
+    }
+    // The rules before i leave the line as it is; from i on, each one
+    // rewrites what the one before produced
+    for (int k = 0; i + 1 < e->nrules; i++, k ^= 1) {
+        e->tmp[k].len = 0;
+        apply(e, i, line, len, &e->tmp[k]);
+        line = e->tmp[k].data;
+        len = e->tmp[k].len;
+    }
+    apply(e, i, line, len, out);
+}
+
+void substitute_line(const struct esub *e, const char *line, size_t len, struct sbuf *out) {
+    if (e->stats == NULL) {
+        rewrite_line(e, line, len, out);
+        return;
+    }
+    double start = stats_now(), expand = e->stats->expand;
+    rewrite_line(e, line, len, out);
+    count_time(e, start, expand);
+}
+
+size_t substitute_lines(const struct esub *e, const char *data, size_t len, int last,
+                        struct sbuf *out) {
+    size_t pos = 0, out_len = out->len;
+    double start = 0, expand = 0;
+
+    if (e->stats != NULL) {
+        start = stats_now();
+        expand = e->stats->expand;
+    }
+    while (pos < len) {
+        if (e->prefilter && e->nrules == 1 && e->rules[0].lit_len > 0) {
+            // Lines before the next occurrence of the literal cannot match:
+            // copy them through in one piece
+            const char *hit = find_literal(&e->rules[0], data + pos, len - pos);
+            const char *nl = NULL;
+            size_t upto;
+            if (hit != NULL)
+                nl = memrchr(data + pos, '\n', (size_t)(hit - (data + pos)));
+            else if (!last)
+                nl = memrchr(data + pos, '\n', len - pos);
+            upto = nl ? (size_t)(nl - data) + 1 : (hit == NULL && last ? len : pos);
+            sbuf_append_mem(out, data + pos, upto - pos);
+            pos = upto;
+            if (hit == NULL) break;
+        }
+
+        const char *nl = memchr(data + pos, '\n', len - pos);
+        if (nl == NULL && !last) break;
+        size_t end = nl ? (size_t)(nl - data) : len;
+        rewrite_line(e, data + pos, end - pos, out);
+        if (nl) sbuf_append_char(out, '\n');
+        pos = nl ? end + 1 : len;
+    }
+    if (e->stats != NULL) {
+        count_time(e, start, expand);
+        e->stats->bytes_in += pos;
+        e->stats->bytes_out += out->len - out_len;
+    }
+    return pos;
+}
+
+static size_t next_match(const struct esub *e, const char *data, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (e->prefilter && e->nrules == 1 && e->rules[0].lit_len > 0) {
+            const char *hit = find_literal(&e->rules[0], data + pos, len - pos);
+            if (hit == NULL) return len;
+            const char *nl = memrchr(data + pos, '\n', (size_t)(hit - (data + pos)));
+            if (nl != NULL) pos = (size_t)(nl - data) + 1;
+        }
+
+        const char *nl = memchr(data + pos, '\n', len - pos);
+        size_t end = nl ? (size_t)(nl - data) : len;
+        if (first_rule(e, data + pos, end - pos) < e->nrules) return pos;
+        pos = nl ? end + 1 : len;
+    }
+    return len;
+}
+
+size_t find_matching_line(const struct esub *e, const char *data, size_t len) {
+    if (e->stats == NULL) return next_match(e, data, len);
+    double start = stats_now(), expand = e->stats->expand;
+    size_t pos = next_match(e, data, len);
+    count_time(e, start, expand);
+    return pos;
+}
@@ -0,0 +1,104 @@
+// subst.h — the substitution engine behind esub
+// A pattern and SUBSTITUTION are compiled once into a `struct esub`, which
+// then rewrites lines in place from any buffer. Errors (bad pattern, bad
+// group reference, out of memory) are reported on stderr and exit with 2,
+// as everywhere in esub.
+#ifndef SUBST_H
+#define SUBST_H
+
+#include <regex.h>
+#include <stddef.h>
+
+#include "match.h"
+#include "stats.h"
+
+#define MAX_REF_OCCURRENCES 100
+
+struct sbuf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+void sbuf_init(struct sbuf *b);
+void sbuf_reserve(struct sbuf *b, size_t add);
+void sbuf_append_mem(struct sbuf *b, const char *s, size_t n);
+void sbuf_append_char(struct sbuf *b, char c);
+size_t sbuf_reallocs(void);    // growths by sbuf_reserve() so far, all threads together
+
+void *xmalloc(size_t n);
+void write_all(int fd, const char *p, size_t n);
+void regerror_die(int code, const regex_t *re, const char *where);
+
+// SUBSTITUTION compiled into ops: a literal span of `lit` or a group
+// reference. Escapes are resolved and references validated against the
+// pattern once, so applying it is a sequence of memcpy()s whose total size
+// is known before the first one.
+struct tmpl_op {
+    int group;             // 1..9, or 0 for the literal lit[off, off + len)
+    size_t off, len;
+};
+
+struct template {
+    char *lit;             // literal text with escapes resolved
+    struct tmpl_op *ops;
+    size_t nops;
+    size_t lit_len;        // bytes of literal text per application
+};
+
+// One REGEXP/SUBSTITUTION pair, compiled.
+struct rule {
+    struct matcher m;
+    struct template subst;
+    int global;            // -g: replace every match, not only the first
+
+    // Prefilter: a literal every match contains. Lines without it are
+    // copied through without calling regexec().
+    char *lit;
+    size_t lit_len;        // 0 when the pattern has no usable literal
+    size_t rare;           // index in lit[] of the byte searched for first
+};
+
+struct rule_spec {
+    const char *pattern;
+    const char *subst;
+    int global;
+};
+
+// Everything that stays the same from one line to the next: the rules,
+// applied in turn to each line like the s commands of a sed script.
+struct esub {
+    struct rule *rules;
+    size_t nrules;
+    // With several rules, all their patterns in one DFA: a line is scanned
+    // once to find the first rule that changes it (NULL: each rule in turn)
+    struct pattern_set *scan;
+    struct sbuf *tmp;      // two lines between rules
+    int prefilter;         // use the literals (on by default)
+    struct esub_stats *stats; // NULL unless counting (esub_count())
+};
+
+// Compile `pattern` (POSIX ERE) for the named matcher (NULL: the best one
+// for the pattern, see match.h) and `subst`; exits on errors.
+void esub_init(struct esub *e, const char *pattern, const char *subst, int global,
+               const char *matcher);
+// The same for n rules.
+void esub_init_rules(struct esub *e, const struct rule_spec *rules, size_t n,
+                     const char *matcher);
+void esub_free(struct esub *e);
+// Count matches, bytes and time into e->stats from now on.
+void esub_count(struct esub *e);
+
+// Append `line` (len bytes, no newline) to `out` with the substitutions applied.
+// Matching runs in place (like REG_STARTEND), so lines need no NUL terminator
+// and may contain NUL bytes.
+void substitute_line(const struct esub *e, const char *line, size_t len, struct sbuf *out);
+// Substitute every complete line of data[0, len) into `out`; with `last`,
+// an unterminated tail counts as a line too. Returns the bytes consumed.
+size_t substitute_lines(const struct esub *e, const char *data, size_t len, int last,
+                        struct sbuf *out);
+// Offset of the first line of data[0, len) that the pattern matches (the
+// line substitute_lines() would be the first to change), or len if none.
+size_t find_matching_line(const struct esub *e, const char *data, size_t len);
+
+#endif
@@ -18,6 +18,233 @@ while IFS=$'\t' read -r re sub s; do
   fi
 done < tests/cases.tsv
 
+echo
+echo '[TEST] -g against sed -E s///g ...'
+while IFS=$'\t' read -r re sub s; do
+  [[ -z "$re" ]] && continue
+  out_esub="$(./esub -g "$re" "$sub" "$s")"
+  out_sed="$(printf '%s\n' "$s" | sed -E "s/${re//\//\\/}/${sub//\//\\/}/g")"
+  if [[ "$out_esub" == "$out_sed" ]]; then
+    printf '  [OK]  -g %s | %s | %s\n' "$re" "$sub" "$s"
+  else
+    printf '  [FAIL] -g %s | %s | %s\n' "$re" "$sub" "$s"
+    printf '    esub: %s\n' "$out_esub"
+    printf '    sed : %s\n' "$out_sed"
+    fail=$((fail+1))
+  fi
+done < <(cat tests/cases.tsv tests/global_cases.tsv)
+
+echo
+echo '[TEST] stdin stream against sed -E ...'
+# All STRINGs as one input, plus a line longer than esub's read block and
+# an unterminated last line
+input="$(mktemp)"
+{ cut -f3 tests/cases.tsv tests/global_cases.tsv
+  head -c 1500000 /dev/zero | tr '\0' 'a'
+  printf '\nb1 22 333'; } > "$input"
+while IFS=$'\t' read -r flags re sub; do
+  [[ -z "$re" ]] && continue
+  if cmp -s <(./esub $flags "$re" "$sub" < "$input") \
+            <(sed -E "s/$re/$sub/${flags//-/}" "$input"); then
+    printf '  [OK]  %s %s | %s\n' "$flags" "$re" "$sub"
+  else
+    printf '  [FAIL] %s %s | %s\n' "$flags" "$re" "$sub"
+    fail=$((fail+1))
+  fi
+done < tests/stream_cases.tsv
+rm -f "$input"
+
+echo
+echo '[TEST] each matcher against sed -E ...'
+while IFS=$'\t' read -r re sub s; do
+  [[ -z "$re" ]] && continue
+  for g in '' g; do
+    out_sed="$(printf '%s\n' "$s" | sed -E "s/${re//\//\\/}/${sub//\//\\/}/$g")"
+    for m in dfa posix; do
+      out_esub="$(./esub ${g:+-g} -m "$m" "$re" "$sub" "$s" 2>&1)"
+      if [[ "$out_esub" != "$out_sed" ]]; then
+        printf '  [FAIL] -m %s %s %s | %s | %s\n' "$m" "${g:+-g}" "$re" "$sub" "$s"
+        printf '    esub: %s\n' "$out_esub"
+        printf '    sed : %s\n' "$out_sed"
+        fail=$((fail+1))
+      fi
+    done
+  done
+  printf '  [OK]  %s | %s | %s\n' "$re" "$sub" "$s"
+done < <(cat tests/cases.tsv tests/global_cases.tsv)
+# Backreferences need posix: chosen automatically, refused for -m dfa
+if [[ "$(./esub '(a)\1' '<\1>' 'baab')" == 'b<a>b' ]] &&
+   ! ./esub -m dfa '(a)\1' x aa >/dev/null 2>&1; then
+  echo '  [OK]  (a)\1 falls back to posix'
+else
+  echo '  [FAIL] (a)\1 falls back to posix'
+  fail=$((fail+1))
+fi
+# GNU anchors are not literals for the prefilter; dfa does not have them
+for re in '\<foo' 'foo\>' '\bfoo' 'o\b' '\Bo' "\\\`a" "r\\'"; do
+  for m in '' '-m posix'; do
+    out_sed="$(printf 'a foo bar\n' | sed -E "s/$re/X/g")"
+    if [[ "$(./esub -g $m "$re" X 'a foo bar')" == "$out_sed" ]]; then
+      printf '  [OK]  %s -g %s\n' "$m" "$re"
+    else
+      printf '  [FAIL] %s -g %s\n' "$m" "$re"
+      fail=$((fail+1))
+    fi
+  done
+done
+# An empty line after STRING's last newline, or on stdin, is still a line
+for m in '' '-m posix' '-m dfa'; do
+  for flags in '' -g; do
+    if cmp -s <(./esub $flags $m '^$' E $'a\n\n') <(printf 'a\n\n\n' | sed -E "s/^$/E/") &&
+       cmp -s <(printf 'a\n\n' | ./esub $flags $m '^$' E) <(printf 'a\n\n' | sed -E "s/^$/E/"); then
+      printf '  [OK]  %s %s empty last line\n' "$m" "$flags"
+    else
+      printf '  [FAIL] %s %s empty last line\n' "$m" "$flags"
+      fail=$((fail+1))
+    fi
+  done
+done
+# regexec needs most of a minute for this line (it retries from every 'a'); the DFA
+# sees at once that nothing matches
+line="$(mktemp)"
+{ head -c 100000 /dev/zero | tr '\0' 'a'; printf ' 1\n'; } > "$line"
+if timeout 10 ./esub -m dfa '([a-z]+) ([a-z]+)' '\2 \1' < "$line" | cmp -s - "$line"; then
+  echo '  [OK]  -m dfa is linear on a 100 kB line'
+else
+  echo '  [FAIL] -m dfa is linear on a 100 kB line'
+  fail=$((fail+1))
+fi
+rm -f "$line"
+# Patterns past the parser's first 64 nodes, so the node array moves while
+# a group is parsed: dfa against posix
+long='([a-c]|x(y|z)+)'
+for i in 1 2 3 4; do long="($long|q$i(r|s)*)[0-9]?"; done
+for re in '(ax((x+)y|xy(^a)y)((bbbby)y)((yax)*)?)' "$long" "$long$long"; do
+  for s in c axxy axyy axxybbbbyyyax xyzq1rs9 'q2r q3 b7xzz' axyybbbbyy; do
+    for g in '' -g; do
+      if [[ "$(./esub $g -m dfa "$re" '<\1>' "$s")" != "$(./esub $g -m posix "$re" '<\1>' "$s")" ]]; then
+        printf '  [FAIL] -m dfa %s %s | %s\n' "$g" "$re" "$s"
+        fail=$((fail+1))
+      fi
+    done
+  done
+done
+echo '  [OK]  patterns of more than 64 nodes'
+
+echo
+echo '[TEST] -F files and -j threads against sed -E ...'
+# Several chunks of the parallel mode, files without a final newline, and
+# a file that is stdin
+big="$(mktemp)" small="$(mktemp)"
+seq 1 1200000 | sed 's/$/ foo boo/' > "$big"
+printf 'boo\nfoo' > "$small"
+for args in '-j 1 -F' '-j 3 -F' '-j 0 -F'; do
+  if cmp -s <(./esub $args -g 'o+' 0 "$big" "$small" - "$small" < "$big") \
+            <(sed -E 's/o+/0/g' "$big" "$small" - "$small" < "$big"); then
+    printf '  [OK]  %s\n' "$args"
+  else
+    printf '  [FAIL] %s\n' "$args"
+    fail=$((fail+1))
+  fi
+done
+if cmp -s <(cat "$big" "$small" | ./esub -j 4 '([0-9]+) foo' 'foo \1') \
+          <(cat "$big" "$small" | sed -E 's/([0-9]+) foo/foo \1/'); then
+  echo '  [OK]  -j 4 on a pipe'
+else
+  echo '  [FAIL] -j 4 on a pipe'
+  fail=$((fail+1))
+fi
+if ./esub -F o 0 /nonexistent >/dev/null 2>&1; then
+  echo '  [FAIL] missing file'
+  fail=$((fail+1))
+else
+  echo '  [OK]  missing file'
+fi
+rm -f "$big" "$small"
+
+echo
+echo '[TEST] -i in place against sed -E -i ...'
+# Spans copied with copy_file_range() and rewritten lines in one file, a
+# file without a final newline, and a file where nothing matches
+dir="$(mktemp -d)"
+seq 1 300000 | sed 's/$/ foo boo/' > "$dir/big"
+printf 'boo\nfoo' > "$dir/small"
+echo nothing > "$dir/none"
+chmod 640 "$dir/big"
+for f in big small none; do cp -p "$dir/$f" "$dir/$f.sed"; done
+inode="$(stat -c %i "$dir/none")"
+./esub -i '^(12345[0-9]*) foo' 'X\1' "$dir/big" "$dir/small" "$dir/none"
+sed -E -i 's/^(12345[0-9]*) foo/X\1/' "$dir/big.sed" "$dir/small.sed" "$dir/none.sed"
+for f in big small none; do
+  if cmp -s "$dir/$f" "$dir/$f.sed"; then
+    printf '  [OK]  %s\n' "$f"
+  else
+    printf '  [FAIL] %s\n' "$f"
+    fail=$((fail+1))
+  fi
+done
+if [[ "$(stat -c %i "$dir/none")" == "$inode" && "$(stat -c %a "$dir/big")" == 640 &&
+      "$(ls -A "$dir" | wc -l)" == 6 ]]; then
+  echo '  [OK]  untouched file, mode, no temporary files left'
+else
+  echo '  [FAIL] untouched file, mode, no temporary files left'
+  fail=$((fail+1))
+fi
+rm -rf "$dir"
+
+echo
+echo '[TEST] -f scripts against sed -E -f ...'
+# Rules that feed each other, other delimiters, comments; with the combined
+# scan (default), and with each rule in turn (posix, or a backreference)
+dir="$(mktemp -d)"
+seq 1 200000 | sed 's/$/ foo boo/' > "$dir/in"
+printf '%s\n' '# comment' 's/([0-9]+) foo/<\1>/' '  s|o+|0|g' '' 's/<(1[0-9]*)>/[\1]/' \
+  's/b0$/B\/E/' > "$dir/script"
+cp "$dir/script" "$dir/backref"
+echo 's/(0) \1/00/' >> "$dir/backref"
+for args in '' '-m posix' '-j 3'; do
+  for s in script backref; do
+    if cmp -s <(./esub $args -F -f "$dir/$s" "$dir/in") <(sed -E -f "$dir/$s" "$dir/in"); then
+      printf '  [OK]  %s %s\n' "$args" "$s"
+    else
+      printf '  [FAIL] %s %s\n' "$args" "$s"
+      fail=$((fail+1))
+    fi
+  done
+done
+if [[ "$(./esub -f "$dir/script" '123 foo')" == '[123]' ]] &&
+   ! ./esub -f /nonexistent x >/dev/null 2>&1 &&
+   ! ./esub -f <(echo 's/a/b/x') x >/dev/null 2>&1; then
+  echo '  [OK]  STRING, missing script, bad rule'
+else
+  echo '  [FAIL] STRING, missing script, bad rule'
+  fail=$((fail+1))
+fi
+rm -rf "$dir"
+
+echo
+echo '[TEST] -s statistics ...'
+report="$(printf 'foo\nbar\nboo\n' | ./esub -s -f <(printf '%s\n' 's/o/0/g' 's/"x"/y/') 2>&1 >/dev/null)"
+for want in '{"pattern": "o", "substitution": "0", "matches": 4, "lines": 2}' \
+            '{"pattern": "\"x\"", "substitution": "y", "matches": 0, "lines": 0}' \
+            '"bytes_scanned": 12,' '"bytes_emitted": 12,' '"sbuf_reallocs": ' '"seconds": {"match": '; do
+  if [[ "$report" == *"$want"* ]]; then
+    printf '  [OK]  %s\n' "$want"
+  else
+    printf '  [FAIL] %s\n' "$want"
+    fail=$((fail+1))
+  fi
+done
+# Bytes that are not UTF-8 still make a JSON string; UTF-8 is left as is
+report="$(printf 'x\n' | ./esub -s $'\xe9t\xc3\xa9' $'\xff' 2>&1 >/dev/null)"
+want='{"pattern": "\u00e9té", "substitution": "\u00ff"'
+if [[ "$report" == *"$want"* ]]; then
+  printf '  [OK]  %s\n' "$want"
+else
+  printf '  [FAIL] %s\n' "$want"
+  fail=$((fail+1))
+fi
+
 echo
 echo '[TEST] error cases (expect non-zero exit) ...'
 while IFS=$'\t' read -r re sub s; do
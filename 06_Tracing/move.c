@@ -1,18 +1,52 @@
 
 #define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64 /* off_t is what copy_file_range() takes */
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 /*
- * move infile outfile
+ * move [-n] [-m METHOD] infile outfile
+ * move [-n] [-m METHOD] [-j JOBS] -b LIST
  * - copy bytes from infile to outfile (truncating/creating outfile)
  * - on success, delete infile
+ * When outfile would be on infile's device, infile is simply renamed
+ * (renameat2()), whatever its size; the copy below is for moves across
+ * devices, or when rename() says EXDEV after all (bind mounts). -n never
+ * replaces an existing outfile: RENAME_NOREPLACE, or O_EXCL for a copy.
+ * -r makes a copy resumable: it checkpoints its progress in a sidecar
+ * (outfile.move-ckpt), keeps a partial outfile that has one when it
+ * fails, and continues from the checkpoint the next time, reporting its
+ * progress on stderr. Only a sidecar that checks out against infile and
+ * outfile makes outfile partial, and so replaceable under -n; any other
+ * sidecar is removed.
+ * -b moves every pair in LIST ("-" for stdin), one "infile<TAB>outfile"
+ * per line, in one process: JOBS threads (default: one per CPU) each take
+ * the next pair and move it exactly as a single move would, so the many
+ * fsync()s of a large batch wait side by side instead of one after another.
+ * -g commits a group of pairs at once instead: all written, then made
+ * durable together (syncfs(), and one fsync() per directory), and only
+ * then all their infiles unlinked.
+ * Copying stays in the kernel where it can: a reflink (FICLONE) shares the
+ * blocks outright, otherwise copy_file_range(), sendfile() or splice()
+ * through a pipe move the bytes, whichever the filesystems support first.
+ * Only when none does, a 1 MiB buffer is read and written. Only data is
+ * copied: holes (SEEK_DATA/SEEK_HOLE) stay holes, and the data ranges are
+ * fallocate()d before they are written. -m copy copies
+ * even on one device; -m clone, copy_file_range, sendfile, splice or rw
+ * forces that one method, without falling back to the next.
  * Safety requirements:
  *  - never delete infile until outfile is fully written, fsync'ed and closed
  *  - if something goes wrong after creating outfile, remove (unlink) outfile
@@ -33,9 +67,23 @@ enum ExitCode {
     EX_CLOSE_OUT = 72,
     EX_CLOSE_IN = 73,
     EX_UNLINK_IN = 74,
-    EX_MEMORY = 75
+    EX_MEMORY = 75,
+    EX_COPY = 76,
+    EX_EXISTS = 77,
+    EX_RENAME = 78
 };
 
+enum Method { M_AUTO, M_COPY, M_CLONE, M_COPY_FILE_RANGE, M_SENDFILE, M_SPLICE, M_RW, M_COUNT };
+
+static const char *const method_names[M_COUNT] = {
+    "auto", "copy", "clone", "copy_file_range", "sendfile", "splice", "rw"
+};
+
+#define COPY_CHUNK (1L << 30)     /* bytes asked of one kernel copy call */
+#define RW_CHUNK (1024 * 1024)    /* the user-space fallback's buffer */
+#define UNSUPPORTED (-1)          /* a copy step's "not here, try the next one" */
+#define TO_EOF INT64_MAX          /* the end of a copy that has no other */
+
 static void perrorf(const char *ctx, const char *path) {
     if (path) {
         fprintf(stderr, "%s: %s: %s\n", ctx, path, strerror(errno));
@@ -52,26 +100,552 @@ static int safe_unlink(const char *path) {
     return 0;
 }
 
-int main(int argc, char **argv) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s infile outfile\n", argv[0]);
-        return EX_USAGE;
+/* errno values by which a copy method says it cannot handle these files */
+static int unsupported(int err) {
+    return err == ENOSYS || err == EOPNOTSUPP || err == ENOTTY || err == EXDEV ||
+           err == EINVAL || err == EBADF || err == ESPIPE;
+}
+
+/*
+ * Each copy step continues from *off (in infile; outfile's file offset is
+ * at the same point) up to `end`, or to EOF if that comes first. It
+ * returns EX_OK, an exit code, or UNSUPPORTED before failing on anything
+ * else, with *off still valid.
+ */
+
+/* Bytes to ask for at once from off to end */
+static size_t chunk(off_t off, off_t end, size_t max) {
+    return end - off < (off_t)max ? (size_t)(end - off) : max;
+}
+
+/* Whole files only: outfile shares infile's blocks, holes and all */
+static int copy_clone(int in_fd, int out_fd, off_t *off, const char *outpath) {
+    if (*off != 0) return UNSUPPORTED;
+    if (ioctl(out_fd, FICLONE, in_fd) == 0) return EX_OK;
+    if (unsupported(errno) || errno == EPERM) return UNSUPPORTED;
+    perrorf("ioctl(FICLONE)", outpath);
+    return EX_COPY;
+}
+
+static int copy_range(int in_fd, int out_fd, off_t *off, off_t end, const char *outpath) {
+    while (*off < end) {
+        ssize_t n = copy_file_range(in_fd, off, out_fd, NULL, chunk(*off, end, COPY_CHUNK), 0);
+        if (n > 0) continue;
+        if (n == 0) break;
+        if (errno == EINTR) continue;
+        if (unsupported(errno)) return UNSUPPORTED;
+        perrorf("copy_file_range", outpath);
+        return EX_COPY;
+    }
+    return EX_OK;
+}
+
+static int copy_sendfile(int in_fd, int out_fd, off_t *off, off_t end, const char *outpath) {
+    while (*off < end) {
+        ssize_t n = sendfile(out_fd, in_fd, off, chunk(*off, end, COPY_CHUNK));
+        if (n > 0) continue;
+        if (n == 0) break;
+        if (errno == EINTR) continue;
+        if (unsupported(errno)) return UNSUPPORTED;
+        perrorf("sendfile", outpath);
+        return EX_COPY;
+    }
+    return EX_OK;
+}
+
+/* infile -> pipe -> outfile: pages are moved between them, not copied out */
+static int copy_splice(int in_fd, int out_fd, off_t *off, off_t end,
+                       const char *inpath, const char *outpath) {
+    int p[2], code = EX_OK;
+    if (pipe2(p, O_CLOEXEC) == -1) return UNSUPPORTED;
+    long cap = fcntl(p[1], F_SETPIPE_SZ, RW_CHUNK);
+    if (cap <= 0) cap = fcntl(p[1], F_GETPIPE_SZ);
+    if (cap <= 0) cap = 65536;
+
+    while (*off < end) {
+        ssize_t n = splice(in_fd, off, p[1], NULL, chunk(*off, end, (size_t)cap), SPLICE_F_MOVE);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (unsupported(errno)) {
+                code = UNSUPPORTED;
+            } else {
+                perrorf("splice", inpath);
+                code = EX_READ;
+            }
+            break;
+        }
+        while (n > 0) {
+            ssize_t w = splice(p[0], NULL, out_fd, NULL, (size_t)n, SPLICE_F_MOVE);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perrorf("splice", outpath);
+                code = EX_WRITE;
+                break;
+            }
+            n -= w;
+        }
+        if (code != EX_OK) break;
+    }
+    close(p[0]);
+    close(p[1]);
+    return code;
+}
+
+/* The last resort: through a buffer in user space */
+static int copy_rw(int in_fd, int out_fd, off_t *off, off_t end,
+                   const char *inpath, const char *outpath) {
+    /* the other steps copy at an offset and leave infile's own alone */
+    if (lseek(in_fd, *off, SEEK_SET) == -1 && errno != ESPIPE) {
+        perrorf("lseek", inpath);
+        return EX_READ;
+    }
+    char *buf = malloc(RW_CHUNK);
+    if (!buf) {
+        perrorf("malloc", NULL);
+        return EX_MEMORY;
+    }
+    int code = EX_OK;
+    while (*off < end) {
+        ssize_t r = read(in_fd, buf, chunk(*off, end, RW_CHUNK));
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perrorf("read", inpath);
+            code = EX_READ;
+            break;
+        }
+        if (r == 0) break;
+        ssize_t done = 0;
+        while (done < r) {
+            ssize_t w = write(out_fd, buf + done, (size_t)(r - done));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perrorf("write", outpath);
+                code = EX_WRITE;
+                break;
+            }
+            done += w;
+        }
+        if (code != EX_OK) break;
+        *off += r;
+    }
+    free(buf);
+    return code;
+}
+
+static int not_supported(int m, const char *inpath, const char *outpath) {
+    fprintf(stderr, "%s: not supported for %s -> %s\n", method_names[m], inpath, outpath);
+    return EX_COPY;
+}
+
+/*
+ * fallocate() the data ranges of a sparse copy before copying: the
+ * filesystem can lay them out in one piece, and a full disk fails now
+ * rather than half-way through. outfile keeps its size: the copy sets it
+ * to what it actually wrote, should infile end early.
+ */
+static int reserve(int in_fd, int out_fd, off_t size, const char *outpath) {
+    off_t off = 0;
+    while (off < size) {
+        off_t data = lseek(in_fd, off, SEEK_DATA);
+        if (data == -1) break; /* ENXIO: only holes left */
+        off_t hole = lseek(in_fd, data, SEEK_HOLE);
+        if (hole == -1) hole = size;
+        if (fallocate(out_fd, FALLOC_FL_KEEP_SIZE, data, hole - data) == -1) {
+            if (errno != ENOSPC && errno != EDQUOT && errno != EFBIG) break; /* allocate as we go */
+            perrorf("fallocate", outpath);
+            return EX_WRITE;
+        }
+        off = hole;
+    }
+    return EX_OK;
+}
+
+/*
+ * Copy infile's data in [*off, stop) with method *m, going on to the next
+ * method (and staying with it) where that one gives up and `fallback`
+ * allows it. With `sparse` (a regular infile) only its data ranges
+ * (SEEK_DATA .. SEEK_HOLE) are copied and outfile is seeked over the
+ * holes. *off ends at stop, or before it at EOF.
+ */
+static int copy_ranges(int in_fd, int out_fd, int *m, int fallback, int sparse,
+                       off_t *off, off_t stop, const char *inpath, const char *outpath) {
+    int holes = sparse, code;
+    while (*off < stop) {
+        off_t end = stop;
+        if (holes) {
+            off_t data = lseek(in_fd, *off, SEEK_DATA);
+            if (data == -1 && errno == ENXIO) data = stop; /* only holes left */
+            if (data == -1) {
+                holes = 0; /* no SEEK_DATA: the rest in one go */
+            } else if (data >= stop) {
+                *off = stop;
+                break;
+            } else {
+                off_t hole = lseek(in_fd, data, SEEK_HOLE);
+                if (hole != -1 && hole < stop) end = hole;
+                *off = data;
+            }
+        }
+        if (sparse && lseek(out_fd, *off, SEEK_SET) == -1) {
+            perrorf("lseek", outpath);
+            return EX_WRITE;
+        }
+        for (;;) {
+            switch (*m) {
+            case M_COPY_FILE_RANGE: code = copy_range(in_fd, out_fd, off, end, outpath); break;
+            case M_SENDFILE: code = copy_sendfile(in_fd, out_fd, off, end, outpath); break;
+            case M_SPLICE: code = copy_splice(in_fd, out_fd, off, end, inpath, outpath); break;
+            default: code = copy_rw(in_fd, out_fd, off, end, inpath, outpath); break;
+            }
+            if (code != UNSUPPORTED) break;
+            if (!fallback) return not_supported(*m, inpath, outpath);
+            (*m)++;
+        }
+        if (code != EX_OK) return code;
+        if (*off < end) break; /* EOF */
+    }
+    return EX_OK;
+}
+
+/* infile ended at `size`, before its fstat() size: so does outfile, without
+   the blocks reserve() set aside past it */
+static int cut_to(int out_fd, off_t size, const char *outpath) {
+    if (ftruncate(out_fd, size) == -1) {
+        perrorf("ftruncate", outpath);
+        return EX_WRITE;
+    }
+    return EX_OK;
+}
+
+/* Holes up to `size` at the end: only outfile's size says they are there */
+static int extend_to(int out_fd, off_t size, const char *outpath) {
+    struct stat st;
+    if (fstat(out_fd, &st) == 0 && st.st_size >= size) return EX_OK;
+    if (ftruncate(out_fd, size) == -1) {
+        perrorf("ftruncate", outpath);
+        return EX_WRITE;
+    }
+    return EX_OK;
+}
+
+/*
+ * -r: a checkpoint of a copy in progress, in a sidecar file next to
+ * outfile. Every CKPT_BYTES, outfile is fdatasync()ed and read back into a
+ * running checksum (the kernel methods never show us the bytes), and the
+ * sidecar is replaced by one that says how far outfile is good, with that
+ * checksum, and which infile it is a copy of. A new run of the same move
+ * that finds the sidecar checks infile is the same, sums outfile's first
+ * `bytes` again, and if they agree continues from there.
+ */
+
+#define CKPT_BYTES (128L << 20)   /* -r: bytes copied between checkpoints */
+#define STEP_BYTES (8L << 20)     /* -r: bytes copied between looks at the clock */
+#define CKPT_SUFFIX ".move-ckpt"
+#define PROGRESS_SECS 2.0         /* -r: seconds between progress lines */
+#define SUM_MOD 4294967291u       /* the largest prime below 2^32 */
+
+struct checkpoint {
+    off_t bytes;                  /* outfile[0, bytes) is written and durable */
+    uint64_t sum;                 /* checksum() of outfile[0, bytes) */
+};
+
+/*
+ * Adler-32 with a 32-bit modulus each for its two sums: 64 bits, updated
+ * as bytes are appended. Start from 1.
+ */
+static uint64_t checksum(uint64_t sum, const unsigned char *p, size_t n) {
+    uint64_t a = sum & 0xffffffffu, b = sum >> 32;
+    while (n > 0) {
+        /* 1 MiB at a time: b cannot overflow 64 bits before it is reduced */
+        size_t k = n < RW_CHUNK ? n : RW_CHUNK;
+        n -= k;
+        while (k--) {
+            a += *p++;
+            b += a;
+        }
+        a %= SUM_MOD;
+        b %= SUM_MOD;
+    }
+    return b << 32 | a;
+}
+
+/* Add outfile[from, to) to *sum, reading it back */
+static int sum_range(int out_fd, off_t from, off_t to, uint64_t *sum, const char *outpath) {
+    unsigned char *buf = malloc(RW_CHUNK);
+    if (!buf) {
+        perrorf("malloc", NULL);
+        return EX_MEMORY;
+    }
+    int code = EX_OK;
+    while (from < to) {
+        ssize_t r = pread(out_fd, buf, chunk(from, to, RW_CHUNK), from);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            if (r == 0) errno = EIO; /* shorter than it was */
+            perrorf("read(outfile)", outpath);
+            code = EX_READ;
+            break;
+        }
+        *sum = checksum(*sum, buf, (size_t)r);
+        from += r;
+    }
+    free(buf);
+    return code;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The sidecar's one line: what infile was, and how far outfile is good */
+#define CKPT_FORMAT "move-checkpoint 2 %llu %llu %llu %lld.%09ld %lld %016llx\n"
+
+/*
+ * Whether outfile (open as out_fd) is a copy of infile, whose stat() is
+ * `inst`, up to the sidecar's checkpoint; a sidecar that is not is removed
+ */
+static int load_checkpoint(const char *ckpt, const struct stat *inst, int out_fd,
+                           struct checkpoint *cp, const char *outpath) {
+    FILE *f = fopen(ckpt, "r");
+    if (!f) return 0;
+    unsigned long long dev, ino, size, sum;
+    long long sec, bytes;
+    long nsec;
+    int n = fscanf(f, CKPT_FORMAT, &dev, &ino, &size, &sec, &nsec, &bytes, &sum);
+    fclose(f);
+
+    struct stat outst;
+    if (n != 7 || dev != (unsigned long long)inst->st_dev ||
+        ino != (unsigned long long)inst->st_ino ||
+        size != (unsigned long long)inst->st_size || sec != (long long)inst->st_mtim.tv_sec ||
+        nsec != inst->st_mtim.tv_nsec) {
+        fprintf(stderr, "%s: checkpoint is not for this infile, starting over\n", outpath);
+        unlink(ckpt);
+        return 0;
+    }
+    if (bytes < 0 || bytes > (long long)inst->st_size || fstat(out_fd, &outst) == -1 ||
+        outst.st_size < bytes) {
+        fprintf(stderr, "%s: shorter than its checkpoint, starting over\n", outpath);
+        unlink(ckpt);
+        return 0;
+    }
+    cp->sum = 1;
+    if (sum_range(out_fd, 0, bytes, &cp->sum, outpath) != EX_OK || cp->sum != sum) {
+        fprintf(stderr, "%s: does not match its checkpoint, starting over\n", outpath);
+        cp->sum = 1;
+        unlink(ckpt);
+        return 0;
+    }
+    cp->bytes = bytes;
+    return 1;
+}
+
+/* Replace the sidecar, by rename(), so a crash leaves the old one or the new */
+static int save_checkpoint(const char *ckpt, const struct stat *inst, const struct checkpoint *cp) {
+    size_t len = strlen(ckpt);
+    char *tmp = malloc(len + sizeof(".tmp"));
+    if (!tmp) return -1;
+    memcpy(tmp, ckpt, len);
+    memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    int ok = fd != -1 &&
+             dprintf(fd, CKPT_FORMAT, (unsigned long long)inst->st_dev,
+                     (unsigned long long)inst->st_ino,
+                     (unsigned long long)inst->st_size, (long long)inst->st_mtim.tv_sec,
+                     inst->st_mtim.tv_nsec, (long long)cp->bytes, (unsigned long long)cp->sum) > 0 &&
+             fdatasync(fd) == 0;
+    if (fd != -1 && close(fd) == -1) ok = 0;
+    if (ok && rename(tmp, ckpt) == -1) ok = 0;
+    if (!ok) {
+        perrorf("checkpoint", ckpt);
+        unlink(tmp);
+    }
+    free(tmp);
+    return ok ? 0 : -1;
+}
+
+static void progress(const char *outpath, off_t done, off_t size, off_t from, double start) {
+    double secs = now() - start;
+    fprintf(stderr, "%s: %.1f of %.1f MiB (%.0f%%), %.1f MiB/s\n", outpath, done / 1048576.0,
+            size / 1048576.0, size ? 100.0 * (double)done / (double)size : 100.0,
+            secs > 0 ? (double)(done - from) / 1048576.0 / secs : 0.0);
+}
+
+/*
+ * infile to outfile with `method`, or with auto/copy the first one that
+ * works. Unless a clone shares it all, a regular infile is copied one data
+ * range (SEEK_DATA .. SEEK_HOLE) at a time, and outfile gets the holes in
+ * between and at the end, so a sparse file stays sparse. With a sidecar
+ * path `ckpt` (-r), a regular infile is copied with checkpoints, from
+ * `resume` if the caller found one that checks out.
+ */
+static int copy_data(int in_fd, int out_fd, enum Method method, const char *inpath,
+                     const char *outpath, const char *ckpt, const struct checkpoint *resume) {
+    off_t off = 0;
+    int fallback = method == M_AUTO || method == M_COPY;
+    int m = fallback ? M_CLONE : (int)method;
+    int code;
+
+    struct stat st;
+    int sparse = fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode);
+    struct checkpoint cp = { 0, 1 };
+    /* -r opened outfile without O_TRUNC: unless there is a checkpoint to
+       go on from, what it held goes, whatever infile is */
+    if (ckpt && sparse && resume) {
+        cp = *resume;
+        fprintf(stderr, "%s: resuming at %.1f MiB\n", outpath, cp.bytes / 1048576.0);
+        off = cp.bytes;
+        if (m == M_CLONE && fallback) m++;
+    } else if (ckpt && ftruncate(out_fd, 0) == -1) {
+        perrorf("ftruncate", outpath);
+        return EX_WRITE;
+    }
+    if (!sparse) ckpt = NULL;
+
+    if (m == M_CLONE) {
+        code = copy_clone(in_fd, out_fd, &off, outpath);
+        if (code != UNSUPPORTED) return code;
+        if (!fallback) return not_supported(m, inpath, outpath);
+        m++;
+    }
+    if (sparse && off == 0 && (code = reserve(in_fd, out_fd, st.st_size, outpath)) != EX_OK)
+        return code;
+
+    if (!ckpt) {
+        code = copy_ranges(in_fd, out_fd, &m, fallback, sparse, &off,
+                           sparse ? st.st_size : TO_EOF, inpath, outpath);
+        if (code != EX_OK || !sparse) return code;
+        if (off < st.st_size) return cut_to(out_fd, off, outpath);
+        return extend_to(out_fd, st.st_size, outpath);
+    }
+
+    off_t from = off;
+    double start = now(), shown = start;
+    while (off < st.st_size) {
+        /* a slow device still reports its progress between checkpoints */
+        off_t stop = st.st_size - off > STEP_BYTES ? off + STEP_BYTES : st.st_size;
+        code = copy_ranges(in_fd, out_fd, &m, fallback, 1, &off, stop, inpath, outpath);
+        if (code != EX_OK) return code;
+        if (off < stop) return cut_to(out_fd, off, outpath); /* infile is shorter than it was */
+        if (off - cp.bytes >= CKPT_BYTES || off == st.st_size) {
+            if ((code = extend_to(out_fd, off, outpath)) != EX_OK) return code;
+            if (fdatasync(out_fd) == -1) {
+                perrorf("fdatasync", outpath);
+                return EX_FSYNC;
+            }
+            if ((code = sum_range(out_fd, cp.bytes, off, &cp.sum, outpath)) != EX_OK) return code;
+            cp.bytes = off;
+            /* Without it the copy is fine, only a restart would begin at zero */
+            save_checkpoint(ckpt, &st, &cp);
+        }
+        if (now() - shown >= PROGRESS_SECS || off == st.st_size) {
+            progress(outpath, off, st.st_size, from, start);
+            shown = now();
+        }
+    }
+    return EX_OK;
+}
+
+/* The directory `path` is in: "." for a bare name */
+static char *parent_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) return strdup(".");
+    while (slash > path && slash[-1] == '/') slash--;
+    return strndup(path, slash == path ? 1 : (size_t)(slash - path));
+}
+
+/* Make the entries of directory `dir` durable */
+static int sync_dir(const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int code = EX_OK;
+    if (fd == -1 || fsync(fd) == -1) {
+        perrorf("fsync(directory)", dir);
+        code = EX_FSYNC;
+    }
+    if (fd != -1) close(fd);
+    return code;
+}
+
+/* Make the name `path` has in its directory durable */
+static int sync_parent(const char *path) {
+    char *dir = parent_dir(path);
+    if (!dir) {
+        perrorf("malloc", NULL);
+        return EX_MEMORY;
+    }
+    int code = sync_dir(dir);
+    free(dir);
+    return code;
+}
+
+/*
+ * Same device: rename infile to outfile. Returns UNSUPPORTED when the
+ * kernel wants a copy after all: EXDEV, or -n on a filesystem without
+ * RENAME_NOREPLACE (the copy gets O_EXCL instead).
+ */
+static int move_rename(const char *inpath, const char *outpath, int noreplace) {
+    int r = renameat2(AT_FDCWD, inpath, AT_FDCWD, outpath, noreplace ? RENAME_NOREPLACE : 0);
+    if (r == -1 && !noreplace && (errno == ENOSYS || errno == EINVAL)) r = rename(inpath, outpath);
+    if (r == 0) return EX_OK;
+    if (errno == EXDEV || (noreplace && (errno == ENOSYS || errno == EINVAL))) return UNSUPPORTED;
+    if (errno == EEXIST) {
+        fprintf(stderr, "outfile exists: %s\n", outpath);
+        return EX_EXISTS;
+    }
+    fprintf(stderr, "rename: %s -> %s: %s\n", inpath, outpath, strerror(errno));
+    return EX_RENAME;
+}
+
+/* outfile's -r sidecar, or NULL without -r */
+static char *ckpt_path(const char *outpath, int resume) {
+    if (!resume) return NULL;
+    size_t len = strlen(outpath);
+    char *ckpt = malloc(len + sizeof(CKPT_SUFFIX));
+    if (ckpt) {
+        memcpy(ckpt, outpath, len);
+        memcpy(ckpt + len, CKPT_SUFFIX, sizeof(CKPT_SUFFIX));
     }
-    const char *inpath = argv[1];
-    const char *outpath = argv[2];
+    return ckpt;
+}
+
+/* Give up on outfile (and on its checkpoint: it is no good either) */
+static void discard(const char *outpath, const char *ckpt) {
+    unlink(outpath);
+    if (ckpt) unlink(ckpt);
+}
+
+/*
+ * The first half of a move, up to making outfile durable. Returns EX_OK
+ * with *out_fd open on the written outfile, or with *out_fd == -1 when
+ * infile was renamed instead; otherwise the exit code, with infile
+ * untouched and outfile removed, unless `ckpt` (-r) has a checkpoint of
+ * it to resume from. infile is closed on the way: if only that fails, the
+ * move goes on with *close_in = EX_CLOSE_IN for the end.
+ */
+static int move_write(const char *inpath, const char *outpath, enum Method method, int noreplace,
+                      const char *ckpt, int *out_fd, int *close_in) {
+    *out_fd = -1;
+    *close_in = EX_OK;
+    struct checkpoint cp = { 0, 1 };
+    int partial = 0;
 
     /* stat() both to catch some edge cases and gather permissions/size */
     struct stat inst, outst;
     if (stat(inpath, &inst) == -1) {
         perrorf("stat(infile)", inpath);
-        return (errno == ENOENT) ? EX_STAT_IN : EX_STAT_IN;
+        return EX_STAT_IN;
     }
     if (S_ISDIR(inst.st_mode)) {
         fprintf(stderr, "infile is a directory: %s\n", inpath);
         return EX_STAT_IN;
     }
-    if (stat(outpath, &outst) == 0) {
-if (S_ISDIR(outst.st_mode)) {
+    int out_exists = stat(outpath, &outst) == 0;
+    if (out_exists) {
+        if (S_ISDIR(outst.st_mode)) {
             fprintf(stderr, "outfile is a directory: %s\n", outpath);
             return EX_OPEN_OUT;
         }
@@ -80,6 +654,34 @@ if (S_ISDIR(outst.st_mode)) {
             fprintf(stderr, "infile and outfile refer to the same file\n");
             return EX_SAME_FILE;
         }
+        /* a partial outfile from an earlier -r run of this move is ours to
+           go on with, but only when its checkpoint checks out */
+        if (ckpt && S_ISREG(inst.st_mode) && S_ISREG(outst.st_mode)) {
+            int fd = open(outpath, O_RDONLY | O_CLOEXEC);
+            partial = fd != -1 && load_checkpoint(ckpt, &inst, fd, &cp, outpath);
+            if (fd != -1) close(fd);
+        }
+        if (noreplace && !partial) {
+            fprintf(stderr, "outfile exists: %s\n", outpath);
+            return EX_EXISTS;
+        }
+    }
+
+    /* Same device as the existing outfile, or as the directory it goes in */
+    if (method == M_AUTO) {
+        struct stat dirst;
+        char *dir = out_exists ? NULL : parent_dir(outpath);
+        int same = out_exists ? outst.st_dev == inst.st_dev
+                              : dir && stat(dir, &dirst) == 0 && dirst.st_dev == inst.st_dev;
+        free(dir);
+        if (same) {
+            /* -n lets a partial outfile be replaced, as the copy does */
+            int code = move_rename(inpath, outpath, noreplace && !partial);
+            /* the sidecar was for the outfile just replaced: the caller
+               syncs the directory after this unlink too */
+            if (code == EX_OK && ckpt) unlink(ckpt);
+            if (code != UNSUPPORTED) return code;
+        }
     }
 
     /* open infile */
@@ -89,138 +691,396 @@ if (S_ISDIR(outst.st_mode)) {
         return EX_OPEN_IN;
     }
 
-    /* open/create outfile with 0666 masked by umask, truncate existing */
+    /* open/create outfile with 0666 masked by umask, truncate existing
+       (with -r later, if there is nothing to resume; -r reads it back) */
     mode_t mode = 0666;
-    int out_fd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
-    if (out_fd == -1) {
+    int flags = ckpt ? O_RDWR | (noreplace && !partial ? O_EXCL : 0)
+                     : O_WRONLY | (noreplace ? O_EXCL : O_TRUNC);
+    int fd = open(outpath, flags | O_CREAT | O_CLOEXEC, mode);
+    if (fd == -1) {
+        int exists = errno == EEXIST;
         perrorf("open(outfile)", outpath);
         close(in_fd); /* ignore close error on the way out */
-        return EX_OPEN_OUT;
+        return exists ? EX_EXISTS : EX_OPEN_OUT;
     }
 
-    /* Decide copy strategy: whole-file into memory if size sane, else chunked */
-    size_t buf_sz = 0;
-    int use_whole = 0;
-    if (S_ISREG(inst.st_mode) && inst.st_size >= 0 && inst.st_size <= (off_t)(256 * 1024 * 1024)) {
-        /* up to 256 MiB read into memory is allowed by the task */
-        buf_sz = (size_t)inst.st_size;
-        use_whole = 1;
-    } else {
-        buf_sz = 1024 * 1024; /* 1 MiB chunks */
-    }
-
-    int exitcode = EX_OK;
-    char *buf = NULL;
-    if (use_whole) {
-        buf = (char*)malloc(buf_sz ? buf_sz : 1);
-        if (!buf) {
-            perrorf("malloc", NULL);
-            exitcode = EX_MEMORY;
-            goto CLEANUP_ON_FAILURE;
-        }
-        /* read exactly file size */
-        size_t total = 0;
-        while (total < buf_sz) {
-            ssize_t r = read(in_fd, buf + total, buf_sz - total);
-            if (r < 0) {
-                perrorf("read", inpath);
-                exitcode = EX_READ;
-                goto CLEANUP_ON_FAILURE;
-            }
-            if (r == 0) break;
-            total += (size_t)r;
-        }
-        if (total != buf_sz) {
-            /* infile was truncated/grown during read; handle by using what we read */
-            buf_sz = total;
-        }
-        /* write all */
-        size_t wtot = 0;
-        while (wtot < buf_sz) {
-            ssize_t w = write(out_fd, buf + wtot, buf_sz - wtot);
-            if (w < 0) {
-                perrorf("write", outpath);
-                exitcode = EX_WRITE;
-                goto CLEANUP_ON_FAILURE;
-            }
-            wtot += (size_t)w;
-        }
-    } else {
-        buf_sz = 1024 * 1024;
-        buf = (char*)malloc(buf_sz);
-        if (!buf) {
-            perrorf("malloc", NULL);
-            exitcode = EX_MEMORY;
-            goto CLEANUP_ON_FAILURE;
-        }
-        while (1) {
-            ssize_t r = read(in_fd, buf, buf_sz);
-            if (r < 0) {
-                perrorf("read", inpath);
-                exitcode = EX_READ;
-                goto CLEANUP_ON_FAILURE;
-            }
-            if (r == 0) break;
-            ssize_t off = 0;
-            while (off < r) {
-                ssize_t w = write(out_fd, buf + off, r - off);
-                if (w < 0) {
-                    perrorf("write", outpath);
-                    exitcode = EX_WRITE;
-                    goto CLEANUP_ON_FAILURE;
-                }
-                off += w;
-            }
-        }
+    /* a sidecar without its outfile, or for another one, is no checkpoint */
+    if (ckpt && !partial) unlink(ckpt);
+    int exitcode = copy_data(in_fd, fd, method, inpath, outpath, ckpt, partial ? &cp : NULL);
+    if (exitcode != EX_OK) {
+        /* Best-effort cleanup: do not touch infile, remove partial outfile */
+        close(fd);
+        if (ckpt && access(ckpt, F_OK) == 0)
+            fprintf(stderr, "%s: kept with its checkpoint; run again with -r to resume\n", outpath);
+        else
+            unlink(outpath);
+        close(in_fd);
+        return exitcode;
+    }
+    if (close(in_fd) == -1) {
+        perrorf("close(infile)", inpath);
+        /* Nothing lost: infile stays until outfile is durable, as always */
+        *close_in = EX_CLOSE_IN;
+    }
+    *out_fd = fd;
+    return EX_OK;
+}
+
+/*
+ * outfile is durable, and so is its name: now it is safe to remove the
+ * source, and then outfile's checkpoint, if any
+ */
+static int move_finish(const char *inpath, const char *ckpt, int close_in) {
+    if (safe_unlink(inpath) == -1) return EX_UNLINK_IN;
+    if (ckpt) unlink(ckpt);
+    return close_in;
+}
+
+/* The whole move of one pair, with -r if `resume`; returns its exit code */
+static int move_file(const char *inpath, const char *outpath, enum Method method, int noreplace,
+                     int resume) {
+    int out_fd, close_in;
+    char *ckpt = ckpt_path(outpath, resume);
+    if (resume && !ckpt) {
+        perrorf("malloc", NULL);
+        return EX_MEMORY;
+    }
+    int exitcode = move_write(inpath, outpath, method, noreplace, ckpt, &out_fd, &close_in);
+    if (exitcode != EX_OK || out_fd == -1) {
+        if (exitcode == EX_OK) exitcode = sync_parent(outpath); /* renamed */
+        free(ckpt);
+        return exitcode;
     }
 
     /* Flush to disk before we even try unlinking the source */
     if (fsync(out_fd) == -1) {
         perrorf("fsync", outpath);
+        close(out_fd);
+        discard(outpath, ckpt);
         exitcode = EX_FSYNC;
-        goto CLEANUP_ON_FAILURE;
-    }
-    if (close(out_fd) == -1) {
+    } else if (close(out_fd) == -1) {
         perrorf("close(outfile)", outpath);
+        discard(outpath, ckpt);
         exitcode = EX_CLOSE_OUT;
-        out_fd = -1; /* still treat as closed to avoid double-close */
-        goto CLEANUP_ON_FAILURE;
+    } else if ((exitcode = sync_parent(outpath)) != EX_OK) {
+        /* ... and outfile's name, or a crash could lose both */
+        discard(outpath, ckpt);
+    } else {
+        exitcode = move_finish(inpath, ckpt, close_in);
     }
-    out_fd = -1; /* mark closed */
+    free(ckpt);
+    return exitcode;
+}
+
+/*
+ * -b: the pairs of a batch, and the threads that move them. With -g the
+ * batch goes in groups, each in steps: every pair of the group written,
+ * then one syncfs() per filesystem and an fdatasync() per outfile (cheap
+ * by then, but it reports that file's own write-back errors), then one
+ * fsync() per target directory, and only then the unlinks.
+ */
+
+#define GROUP_MAX 4096 /* -g: pairs written before a group commit */
+
+struct pair {
+    char *inpath, *outpath;
+    int code;
+    int out_fd;                /* -g: written, not yet durable */
+    int copied;                /* -g: infile is still there to unlink */
+    int close_in;
+    char *dir;                 /* -g: outfile's directory */
+};
+
+struct batch {
+    struct pair *pairs;
+    size_t npairs;
+    size_t next, end;          /* pairs [next, end) are left for this step */
+    void (*step)(const struct batch *, struct pair *);
+    enum Method method;
+    int noreplace;
+    int resume;
+    pthread_mutex_t lock;
+};
 
-    /* Now it is safe to remove the source */
-    if (safe_unlink(inpath) == -1) {
-        exitcode = EX_UNLINK_IN;
-        goto CLEANUP_ONLY_INFILE; /* do NOT remove outfile */
+static void step_move(const struct batch *b, struct pair *p) {
+    p->code = move_file(p->inpath, p->outpath, b->method, b->noreplace, b->resume);
+}
+
+static void step_write(const struct batch *b, struct pair *p) {
+    p->code = move_write(p->inpath, p->outpath, b->method, b->noreplace, NULL, &p->out_fd,
+                         &p->close_in);
+    p->copied = p->out_fd != -1;
+    if (p->code == EX_OK && !(p->dir = parent_dir(p->outpath))) {
+        perrorf("malloc", NULL);
+        p->code = EX_MEMORY;
     }
+    if (p->code != EX_OK && p->out_fd != -1) {
+        close(p->out_fd);
+        p->out_fd = -1;
+        unlink(p->outpath);
+    }
+}
 
-    /* Finalize: close infile and exit OK */
-    if (close(in_fd) == -1) {
-        perrorf("close(infile)", inpath);
-        /* We already deleted infile successfully; treat close(in) failure as separate */
-        return EX_CLOSE_IN;
+static void step_datasync(const struct batch *b, struct pair *p) {
+    (void)b;
+    if (p->out_fd == -1) return;
+    if (fdatasync(p->out_fd) == -1) {
+        perrorf("fdatasync", p->outpath);
+        p->code = EX_FSYNC;
     }
-    free(buf);
-    return EX_OK;
+    if (close(p->out_fd) == -1 && p->code == EX_OK) {
+        perrorf("close(outfile)", p->outpath);
+        p->code = EX_CLOSE_OUT;
+    }
+    p->out_fd = -1;
+    if (p->code != EX_OK) unlink(p->outpath);
+}
 
-CLEANUP_ON_FAILURE:
-    /* Best-effort cleanup: do not touch infile, remove partial outfile */
-    if (out_fd != -1) {
-        /* try to ensure metadata/dirty page states are irrelevant */
-        /* ignore fsync here; we're deleting anyway */
-        close(out_fd);
-        out_fd = -1;
+static void step_finish(const struct batch *b, struct pair *p) {
+    (void)b;
+    if (p->code == EX_OK && p->copied) p->code = move_finish(p->inpath, NULL, p->close_in);
+}
+
+static void *batch_worker(void *arg) {
+    struct batch *b = arg;
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        size_t i = b->next < b->end ? b->next++ : b->end;
+        pthread_mutex_unlock(&b->lock);
+        if (i == b->end) return NULL;
+        b->step(b, &b->pairs[i]);
     }
-    /* remove partial target to be safe */
-    if (unlink(outpath) == -1) {
-        /* ignore error; nothing we can do */
+}
+
+/* Run `step` on pairs [from, to) with up to `jobs` threads */
+static void run_step(struct batch *b, size_t from, size_t to, long jobs,
+                     void (*step)(const struct batch *, struct pair *)) {
+    long started = 0;
+
+    b->next = from;
+    b->end = to;
+    b->step = step;
+    if (jobs > (long)(to - from)) jobs = (long)(to - from);
+    pthread_t *threads = malloc((size_t)jobs * sizeof(*threads));
+    while (threads && started < jobs &&
+           pthread_create(&threads[started], NULL, batch_worker, b) == 0)
+        started++;
+    /* fewer threads then, but at least this one */
+    if (started == 0) batch_worker(b);
+    for (long t = 0; t < started; t++) pthread_join(threads[t], NULL);
+    free(threads);
+}
+
+static int by_dir(const void *x, const void *y) {
+    return strcmp((*(struct pair *const *)x)->dir, (*(struct pair *const *)y)->dir);
+}
+
+/* The group commit of pairs [from, to), all written by step_write */
+static void commit_group(struct batch *b, size_t from, size_t to, long jobs) {
+    /* Write back each filesystem once; outfiles on one already seen are skipped */
+    dev_t *synced = malloc((to - from) * sizeof(*synced));
+    size_t nsynced = 0;
+    for (size_t i = from; synced && i < to; i++) {
+        struct pair *p = &b->pairs[i];
+        struct stat st;
+        size_t k = 0;
+        if (p->out_fd == -1 || fstat(p->out_fd, &st) == -1) continue;
+        while (k < nsynced && synced[k] != st.st_dev) k++;
+        if (k < nsynced) continue;
+        synced[nsynced++] = st.st_dev;
+        /* Errors show up again in the fdatasync() of the file they hit */
+        if (syncfs(p->out_fd) == -1) perrorf("syncfs", p->outpath);
     }
-CLEANUP_ONLY_INFILE:
-    /* Close infile last */
-    if (in_fd != -1) {
-        close(in_fd);
-        in_fd = -1;
+    free(synced);
+    run_step(b, from, to, jobs, step_datasync);
+
+    /* One fsync() per directory, for every name created in it */
+    struct pair **sorted = malloc((to - from) * sizeof(*sorted));
+    size_t n = 0;
+    for (size_t i = from; i < to; i++) {
+        if (b->pairs[i].code != EX_OK) continue;
+        if (sorted) {
+            sorted[n++] = &b->pairs[i];
+        } else {
+            /* no memory to sort: a directory fsync per pair instead */
+            b->pairs[i].code = sync_dir(b->pairs[i].dir);
+            if (b->pairs[i].code != EX_OK && b->pairs[i].copied) unlink(b->pairs[i].outpath);
+        }
     }
-    free(buf);
+    if (sorted) qsort(sorted, n, sizeof(*sorted), by_dir);
+    for (size_t i = 0, j; i < n; i = j) {
+        int code = sync_dir(sorted[i]->dir);
+        for (j = i; j < n && strcmp(sorted[j]->dir, sorted[i]->dir) == 0; j++) {
+            if (code == EX_OK) continue;
+            sorted[j]->code = code;
+            /* a rename cannot be taken back; a copy can, and infile is still there */
+            if (sorted[j]->copied) unlink(sorted[j]->outpath);
+        }
+    }
+    free(sorted);
+
+    run_step(b, from, to, jobs, step_finish);
+}
+
+/* How many pairs a group can hold: each keeps its outfile open */
+static size_t group_size(long jobs) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1) return 1;
+    if (rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    /* infile, outfile and a pipe per thread, stdio and some to spare */
+    rlim_t reserve = 4 * (rlim_t)jobs + 16;
+    if (rl.rlim_cur <= reserve) return 1;
+    return rl.rlim_cur - reserve < GROUP_MAX ? (size_t)(rl.rlim_cur - reserve) : GROUP_MAX;
+}
+
+/* Read "infile<TAB>outfile" lines; empty lines are skipped */
+static int read_list(const char *listpath, struct batch *b) {
+    FILE *f = strcmp(listpath, "-") == 0 ? stdin : fopen(listpath, "r");
+    if (!f) {
+        perrorf("open(list)", listpath);
+        return EX_USAGE;
+    }
+    char *line = NULL;
+    size_t cap = 0, alloc = 0, lineno = 0;
+    ssize_t len;
+    int code = EX_OK;
+    while ((len = getline(&line, &cap, f)) != -1) {
+        lineno++;
+        if (len > 0 && line[len - 1] == '\n') line[--len] = '\0';
+        if (len == 0) continue;
+        char *tab = strchr(line, '\t');
+        if (!tab || tab == line || tab[1] == '\0' || strchr(tab + 1, '\t')) {
+            fprintf(stderr, "%s:%zu: expected infile<TAB>outfile\n", listpath, lineno);
+            code = EX_USAGE;
+            break;
+        }
+        if (b->npairs == alloc) {
+            alloc = alloc ? 2 * alloc : 64;
+            struct pair *grown = realloc(b->pairs, alloc * sizeof(*grown));
+            if (!grown) {
+                perrorf("realloc", NULL);
+                code = EX_MEMORY;
+                break;
+            }
+            b->pairs = grown;
+        }
+        *tab = '\0';
+        struct pair *p = &b->pairs[b->npairs];
+        p->inpath = strdup(line);
+        p->outpath = strdup(tab + 1);
+        p->code = EX_OK;
+        p->out_fd = -1;
+        p->copied = 0;
+        p->close_in = EX_OK;
+        p->dir = NULL;
+        if (!p->inpath || !p->outpath) {
+            free(p->inpath);
+            free(p->outpath);
+            perrorf("strdup", NULL);
+            code = EX_MEMORY;
+            break;
+        }
+        b->npairs++;
+    }
+    if (code == EX_OK && ferror(f)) {
+        perrorf("read(list)", listpath);
+        code = EX_USAGE;
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+    return code;
+}
+
+/*
+ * Move every pair of the list with `jobs` threads, each pair on its own
+ * or, with `group`, a group at a time. Each failure is reported with its
+ * pair; the exit code is that of the first failed pair in list order, so
+ * it does not depend on the threads' timing.
+ */
+static int move_batch(const char *listpath, long jobs, enum Method method, int noreplace,
+                      int group, int resume) {
+    struct batch b = { .method = method, .noreplace = noreplace, .resume = resume };
+    int exitcode = read_list(listpath, &b);
+
+    if (exitcode == EX_OK && b.npairs > 0) {
+        pthread_mutex_init(&b.lock, NULL);
+        if (!group) {
+            run_step(&b, 0, b.npairs, jobs, step_move);
+        } else {
+            size_t size = group_size(jobs);
+            for (size_t from = 0; from < b.npairs; from += size) {
+                size_t to = b.npairs - from < size ? b.npairs : from + size;
+                run_step(&b, from, to, jobs, step_write);
+                commit_group(&b, from, to, jobs);
+            }
+        }
+        pthread_mutex_destroy(&b.lock);
+
+        size_t failed = 0;
+        for (size_t i = 0; i < b.npairs; i++) {
+            if (b.pairs[i].code == EX_OK) continue;
+            fprintf(stderr, "failed (exit %d): %s -> %s\n", b.pairs[i].code,
+                    b.pairs[i].inpath, b.pairs[i].outpath);
+            if (failed++ == 0) exitcode = b.pairs[i].code;
+        }
+        if (failed > 0)
+            fprintf(stderr, "%zu of %zu moves failed\n", failed, b.npairs);
+    }
+
+    for (size_t i = 0; i < b.npairs; i++) {
+        free(b.pairs[i].inpath);
+        free(b.pairs[i].outpath);
+        free(b.pairs[i].dir);
+    }
+    free(b.pairs);
     return exitcode;
 }
+
+static int usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n] [-r] [-m METHOD] infile outfile\n"
+            "       %s [-n] [-r] [-m METHOD] [-j JOBS] [-g] -b LIST   (not -r with -g)\n"
+            "METHOD: auto, copy, clone, copy_file_range, sendfile, splice, rw\n",
+            prog, prog);
+    return EX_USAGE;
+}
+
+int main(int argc, char **argv) {
+    enum Method method = M_AUTO;
+    const char *listpath = NULL;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int noreplace = 0, group = 0, resume = 0, opt;
+    while ((opt = getopt(argc, argv, "nrm:j:gb:")) != -1) {
+        if (opt == 'm') {
+            int m = 0;
+            while (m < M_COUNT && strcmp(optarg, method_names[m]) != 0) m++;
+            if (m == M_COUNT) return usage(argv[0]);
+            method = (enum Method)m;
+        } else if (opt == 'j') {
+            char *end;
+            jobs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || jobs < 1) return usage(argv[0]);
+        } else if (opt == 'n') {
+            noreplace = 1;
+        } else if (opt == 'r') {
+            resume = 1;
+        } else if (opt == 'g') {
+            group = 1;
+        } else if (opt == 'b') {
+            listpath = optarg;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (jobs < 1) jobs = 1;
+
+    if (listpath) {
+        if (optind != argc || (group && resume)) return usage(argv[0]);
+        return move_batch(listpath, jobs, method, noreplace, group, resume);
+    }
+    if (group || argc - optind != 2) return usage(argv[0]);
+    return move_file(argv[optind], argv[optind + 1], method, noreplace, resume);
+}
@@ -11,7 +11,9 @@
 /* 
  * LD_PRELOAD-able library that prevents deletion of any path whose
  * name contains the substring "PROTECT". It intercepts unlink, unlinkat,
- * and remove. For non-matching paths, it calls the real functions.
+ * and remove, and rename, renameat and renameat2 (renaming a protected
+ * file away deletes its name just as well). For non-matching paths, it
+ * calls the real functions.
  */
 
 static int contains_protect(const char *path) {
@@ -22,6 +24,9 @@ static int contains_protect(const char *path) {
 typedef int (*unlink_fn)(const char *);
 typedef int (*unlinkat_fn)(int, const char *, int);
 typedef int (*remove_fn)(const char *);
+typedef int (*rename_fn)(const char *, const char *);
+typedef int (*renameat_fn)(int, const char *, int, const char *);
+typedef int (*renameat2_fn)(int, const char *, int, const char *, unsigned int);
 
 static void *sym(const char *name) {
     void *p = dlsym(RTLD_NEXT, name);
@@ -61,3 +66,34 @@ int remove(const char *pathname) {
     remove_fn real_remove = (remove_fn)sym("remove");
     return real_remove(pathname);
 }
+
+int rename(const char *oldpath, const char *newpath) {
+    if (contains_protect(oldpath)) {
+        errno = EPERM;
+        fprintf(stderr, "protect.so: refusing to rename '%s'\n", oldpath);
+        return -1;
+    }
+    rename_fn real_rename = (rename_fn)sym("rename");
+    return real_rename(oldpath, newpath);
+}
+
+int renameat(int olddirfd, const char *oldpath, int newdirfd, const char *newpath) {
+    if (contains_protect(oldpath)) {
+        errno = EPERM;
+        fprintf(stderr, "protect.so: refusing to renameat '%s'\n", oldpath);
+        return -1;
+    }
+    renameat_fn real_renameat = (renameat_fn)sym("renameat");
+    return real_renameat(olddirfd, oldpath, newdirfd, newpath);
+}
+
+int renameat2(int olddirfd, const char *oldpath, int newdirfd, const char *newpath,
+              unsigned int flags) {
+    if (contains_protect(oldpath)) {
+        errno = EPERM;
+        fprintf(stderr, "protect.so: refusing to renameat2 '%s'\n", oldpath);
+        return -1;
+    }
+    renameat2_fn real_renameat2 = (renameat2_fn)sym("renameat2");
+    return real_renameat2(olddirfd, oldpath, newdirfd, newpath, flags);
+}
@@ -22,6 +22,9 @@ EX_CLOSE_OUT=72
 EX_CLOSE_IN=73
 EX_UNLINK_IN=74
 EX_MEMORY=75
+EX_COPY=76
+EX_EXISTS=77
+EX_RENAME=78
 
 TMPDIR="$(mktemp -d)"
 cleanup() { rm -rf "$TMPDIR"; }
@@ -33,14 +36,226 @@ OUT="$TMPDIR/out.txt"
 # helper: create IN with content
 echo "hello world" > "$IN"
 
-# 1) happy path
+# 1) happy path: on one filesystem, a rename (the inode stays)
+ino=$(stat -c %i "$IN")
 ./move "$IN" "$OUT"
 code=$?
 [[ $code -eq $EX_OK ]] || fail "happy path exit code $code != $EX_OK"
 [[ ! -e "$IN" ]] || fail "infile should be removed"
 diff -u <(echo "hello world") "$OUT" >/dev/null || fail "content mismatch"
+[[ $(stat -c %i "$OUT") -eq $ino ]] || fail "same-device move should rename, not copy"
 ok "happy path"
 
+# 1a) -m copy copies even on one filesystem; -n does not replace outfile
+echo "hello world" > "$IN"
+ino=$(stat -c %i "$IN")
+./move -m copy "$IN" "$OUT" || fail "copy: exit $? != $EX_OK"
+[[ ! -e "$IN" && $(stat -c %i "$OUT") -ne $ino ]] || fail "-m copy should copy"
+ok "-m copy"
+for m in auto copy; do
+  echo "new" > "$IN"
+  set +e
+  ./move -n -m $m "$IN" "$OUT" 2>/dev/null
+  code=$?
+  set -e
+  [[ $code -eq $EX_EXISTS ]] || fail "-n -m $m onto an existing outfile: exit $code, expected $EX_EXISTS"
+  [[ $(cat "$IN") == new && $(cat "$OUT") == "hello world" ]] || fail "-n -m $m must leave both files alone"
+done
+rm -f "$OUT"
+./move -n "$IN" "$OUT" || fail "-n onto no outfile: exit $?"
+[[ ! -e "$IN" && $(cat "$OUT") == new ]] || fail "-n onto no outfile should move"
+ok "-n (no replace)"
+
+# 1a') across filesystems (when /dev/shm is another one): a copy
+if [[ -d /dev/shm && -w /dev/shm && $(stat -c %d /dev/shm) != $(stat -c %d "$TMPDIR") ]]; then
+  SHM="$(mktemp -d /dev/shm/move_test.XXXXXX)"
+  echo "new" > "$SHM/in"
+  set +e
+  ./move "$SHM/in" "$TMPDIR/xdev"
+  code=$?
+  set -e
+  rm -rf "$SHM"
+  [[ $code -eq $EX_OK ]] || fail "cross-device move: exit $code != $EX_OK"
+  [[ $(cat "$TMPDIR/xdev") == new ]] || fail "cross-device move: content mismatch"
+  ok "cross-device move"
+fi
+
+# 1b) every copy method on a multi-MiB file: clone may be unsupported here
+#     (exit EX_COPY, nothing moved), the others must all work
+head -c 5000000 /dev/urandom > "$TMPDIR/src"
+for m in auto copy clone copy_file_range sendfile splice rw; do
+  cp "$TMPDIR/src" "$IN"
+  set +e
+  ./move -m "$m" "$IN" "$OUT" 2>/dev/null
+  code=$?
+  set -e
+  if [[ $m == clone && $code -eq $EX_COPY ]]; then
+    [[ -e "$IN" && ! -e "$OUT" ]] || fail "clone unsupported: infile must remain, outfile must go"
+    ok "method $m (not supported here)"
+    continue
+  fi
+  [[ $code -eq $EX_OK ]] || fail "method $m: exit $code != $EX_OK"
+  [[ ! -e "$IN" ]] || fail "method $m: infile should be removed"
+  cmp -s "$TMPDIR/src" "$OUT" || fail "method $m: content mismatch"
+  ok "method $m"
+done
+# 1b') a sparse file stays sparse with every method that copies (when
+#      this filesystem makes sparse files at all)
+SPARSE="$TMPDIR/sparse"
+rm -f "$SPARSE"
+truncate -s 64M "$SPARSE"
+head -c 100000 "$TMPDIR/src" | dd of="$SPARSE" conv=notrunc status=none
+head -c 100000 "$TMPDIR/src" | dd of="$SPARSE" bs=1M seek=32 conv=notrunc status=none
+truncate -s 96M "$SPARSE"
+if [[ $(stat -c %b "$SPARSE") -lt 4096 ]]; then
+  for m in copy copy_file_range sendfile splice rw; do
+    cp --sparse=always "$SPARSE" "$IN"
+    set +e
+    ./move -m "$m" "$IN" "$OUT" 2>/dev/null
+    code=$?
+    set -e
+    # copy_file_range may not cross filesystems here; the others must work
+    [[ $m == copy_file_range && $code -eq $EX_COPY ]] && continue
+    [[ $code -eq $EX_OK ]] || fail "sparse, method $m: exit $code != $EX_OK"
+    cmp -s "$SPARSE" "$OUT" || fail "sparse, method $m: content mismatch"
+    [[ $(stat -c %b "$OUT") -lt 4096 ]] || fail "sparse, method $m: holes filled in ($(stat -c %b "$OUT") blocks)"
+  done
+  ok "sparse files stay sparse"
+fi
+
+# 1b'') -r: a checkpointed copy; a checkpoint that does not check out
+#       (another infile) is ignored and the copy starts over
+cp "$TMPDIR/src" "$IN"
+./move -r -m copy "$IN" "$OUT" 2>/dev/null || fail "-r: exit $? != $EX_OK"
+cmp -s "$TMPDIR/src" "$OUT" || fail "-r: content mismatch"
+[[ ! -e "$IN" && ! -e "$OUT.move-ckpt" ]] || fail "-r: infile and checkpoint should be removed"
+cp "$TMPDIR/src" "$IN"
+echo "move-checkpoint 2 0 1 2 3.000000000 4096 0000000000000001" > "$OUT.move-ckpt"
+./move -r -m copy "$IN" "$OUT" 2> "$TMPDIR/err" || fail "-r over a stale checkpoint: exit $?"
+grep -q "starting over" "$TMPDIR/err" || fail "-r: a stale checkpoint should be reported"
+cmp -s "$TMPDIR/src" "$OUT" || fail "-r over a stale checkpoint: content mismatch"
+[[ ! -e "$OUT.move-ckpt" ]] || fail "-r: checkpoint should be removed"
+# same inode, size and mtime, another device: still another infile
+for d in 1 0; do
+  cp "$TMPDIR/src" "$IN"
+  printf 'move-checkpoint 2 %s %s %s %s.%s 0 0000000000000001\n' \
+    $(( $(stat -c %d "$IN") + d )) $(stat -c '%i %s' "$IN") \
+    $(stat -c %Y "$IN") $(stat -c %y "$IN" | sed 's/.*\.\([0-9]*\).*/\1/') > "$OUT.move-ckpt"
+  ./move -r -m copy "$IN" "$OUT" 2> "$TMPDIR/err" || fail "-r, checkpoint device $d: exit $?"
+  if [[ $d -eq 1 ]]; then
+    grep -q "starting over" "$TMPDIR/err" || fail "-r: a checkpoint from another device should be ignored"
+  else
+    ! grep -q "starting over" "$TMPDIR/err" || fail "-r: a checkpoint of this infile should be taken"
+  fi
+  cmp -s "$TMPDIR/src" "$OUT" || fail "-r, checkpoint device $d: content mismatch"
+done
+# infile a fifo: no checkpoints, but a longer outfile is still replaced
+rm -f "$IN"
+mkfifo "$IN"
+echo "short" > "$IN" &
+./move -r -m copy "$IN" "$OUT" 2>/dev/null || fail "-r from a fifo: exit $?"
+wait
+diff -u <(echo "short") "$OUT" >/dev/null || fail "-r from a fifo: stale bytes after the copy"
+# on one filesystem -r renames: a leftover checkpoint goes with the old outfile
+cp "$TMPDIR/src" "$IN"
+echo "move-checkpoint 2 0 1 2 3.000000000 4096 0000000000000001" > "$OUT.move-ckpt"
+./move -r "$IN" "$OUT" 2>/dev/null || fail "-r rename: exit $?"
+cmp -s "$TMPDIR/src" "$OUT" || fail "-r rename: content mismatch"
+[[ ! -e "$OUT.move-ckpt" ]] || fail "-r rename: checkpoint should be removed"
+# ... with -n, the outfile of an unfinished -r run of this move is replaced
+#     (the run is cut short by libprotect.so keeping infile from being unlinked)
+PIN="$TMPDIR/PROTECT_in"
+cp "$TMPDIR/src" "$PIN"
+set +e
+LD_PRELOAD="$(pwd)/libprotect.so" ./move -r -m copy "$PIN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_UNLINK_IN && -e "$OUT.move-ckpt" ]] || fail "-r cut short: exit $code, expected $EX_UNLINK_IN and a checkpoint"
+./move -n -r "$PIN" "$OUT" 2>/dev/null || fail "-n -r rename over a partial: exit $?"
+cmp -s "$TMPDIR/src" "$OUT" || fail "-n -r rename: content mismatch"
+[[ ! -e "$PIN" && ! -e "$OUT.move-ckpt" ]] || fail "-n -r rename: infile and checkpoint should be removed"
+# ... but an outfile whose sidecar is not for this infile is not
+for m in auto copy; do
+  cp "$TMPDIR/src" "$IN"
+  echo "keep me" > "$OUT"
+  echo "move-checkpoint 2 0 1 2 3.000000000 4096 0000000000000001" > "$OUT.move-ckpt"
+  set +e
+  ./move -n -r -m $m "$IN" "$OUT" 2>/dev/null
+  code=$?
+  set -e
+  [[ $code -eq $EX_EXISTS ]] || fail "-n -r -m $m over a foreign sidecar: exit $code, expected $EX_EXISTS"
+  [[ -e "$IN" && $(cat "$OUT") == "keep me" ]] || fail "-n -r -m $m: infile and outfile must stay"
+  [[ ! -e "$OUT.move-ckpt" ]] || fail "-n -r -m $m: a foreign sidecar should be removed"
+done
+ok "-r (resumable copy)"
+
+set +e
+./move -m bogus "$IN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_USAGE ]] || fail "unknown method: exit $code != $EX_USAGE"
+ok "unknown method"
+
+# 1c) batch: every pair moved, each as a single move would do it
+mkdir -p "$TMPDIR/batch/src" "$TMPDIR/batch/dst"
+LIST="$TMPDIR/batch/list"
+: > "$LIST"
+for i in $(seq 1 100); do
+  head -c $((i * 997)) "$TMPDIR/src" > "$TMPDIR/batch/src/f$i"
+  printf '%s\t%s\n' "$TMPDIR/batch/src/f$i" "$TMPDIR/batch/dst/f$i" >> "$LIST"
+done
+./move -j 4 -b "$LIST" || fail "batch: exit $? != $EX_OK"
+for i in $(seq 1 100); do
+  [[ ! -e "$TMPDIR/batch/src/f$i" ]] || fail "batch: infile f$i should be removed"
+  cmp -s <(head -c $((i * 997)) "$TMPDIR/src") "$TMPDIR/batch/dst/f$i" || fail "batch: f$i content mismatch"
+done
+ok "batch of 100 files"
+
+# 1d) batch with a failing pair: the others still move, the exit code is
+#     the failed pair's and stderr names it
+echo one > "$TMPDIR/batch/src/a"
+echo two > "$TMPDIR/batch/src/b"
+printf '%s\t%s\n' "$TMPDIR/batch/src/a" "$TMPDIR/batch/dst/a" \
+  "$TMPDIR/batch/src/missing" "$TMPDIR/batch/dst/missing" \
+  "$TMPDIR/batch/src/b" "$TMPDIR/batch/dst/b" > "$LIST"
+set +e
+./move -j 2 -b "$LIST" 2> "$TMPDIR/batch/err"
+code=$?
+set -e
+[[ $code -eq $EX_STAT_IN ]] || fail "batch with a missing infile: exit $code, expected $EX_STAT_IN"
+grep -q "missing -> .*missing" "$TMPDIR/batch/err" || fail "batch: the failed pair is not reported"
+[[ -e "$TMPDIR/batch/dst/a" && -e "$TMPDIR/batch/dst/b" ]] || fail "batch: the other pairs must be moved"
+[[ ! -e "$TMPDIR/batch/src/a" && ! -e "$TMPDIR/batch/src/b" ]] || fail "batch: moved infiles must be removed"
+ok "batch with a failing pair"
+
+# 1e) group commit, copying (-m copy) and renaming, with a failing pair
+for m in copy auto; do
+  : > "$LIST"
+  for i in $(seq 1 50); do
+    echo "g$i" > "$TMPDIR/batch/src/g$i"
+    printf '%s\t%s\n' "$TMPDIR/batch/src/g$i" "$TMPDIR/batch/dst/g$i" >> "$LIST"
+  done
+  printf '%s\t%s\n' "$TMPDIR/batch/src/missing" "$TMPDIR/batch/dst/missing" >> "$LIST"
+  set +e
+  ./move -m $m -j 3 -g -b "$LIST" 2> "$TMPDIR/batch/err"
+  code=$?
+  set -e
+  [[ $code -eq $EX_STAT_IN ]] || fail "group commit -m $m: exit $code, expected $EX_STAT_IN"
+  grep -q "missing -> .*missing" "$TMPDIR/batch/err" || fail "group commit: the failed pair is not reported"
+  for i in $(seq 1 50); do
+    [[ ! -e "$TMPDIR/batch/src/g$i" && $(cat "$TMPDIR/batch/dst/g$i") == "g$i" ]] ||
+      fail "group commit -m $m: g$i not moved"
+  done
+  ok "group commit (-g, -m $m)"
+done
+
+set +e
+printf 'no tab here\n' | ./move -b - >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_USAGE ]] || fail "malformed list: exit $code != $EX_USAGE"
+ok "malformed batch list"
+
 # Recreate IN for error-injection tests
 echo "hello world" > "$IN"
 
@@ -54,20 +269,36 @@ mkdir -p "$RODIR"
 chmod 0555 "$RODIR"
 OUT="$RODIR/out.txt"
 set +e
-./move "$IN" "$OUT" >/dev/null 2>&1
+./move -m copy "$IN" "$OUT" >/dev/null 2>&1
 code=$?
 set -e
 chmod 0755 "$RODIR"
 [[ $code -eq $EX_OPEN_OUT ]] || fail "permission test: exit $code, expected $EX_OPEN_OUT"
 [[ -e "$IN" ]] || fail "infile must remain after open(out) permission failure"
 [[ ! -e "$OUT" ]] || fail "outfile must not exist after open(out) permission failure"
-OUT="$TMPDIR/out.txt"
 ok "permission-based open(out) failure"
 
-# 3) inject write failure (EIO) on OUT
+# 2b) the same directory without -m copy: rename(2) fails, nothing moves
+chmod 0555 "$RODIR"
+set +e
+./move "$IN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+chmod 0755 "$RODIR"
+if [[ $code -eq $EX_OK ]]; then
+  echo "permissions not enforced (root?); skipping rename permission test"
+  ./move "$OUT" "$IN"
+else
+  [[ $code -eq $EX_RENAME ]] || fail "rename permission test: exit $code, expected $EX_RENAME"
+  [[ -e "$IN" && ! -e "$OUT" ]] || fail "infile must remain after a failed rename"
+  ok "permission-based rename failure"
+fi
+OUT="$TMPDIR/out.txt"
+
+# 3) inject write failure (EIO) on OUT; read/write only happen with -m rw
 echo "hello world" > "$IN"
 set +e
-strace -qq -P "$OUT" -e fault=write:error=EIO:when=1 ./move "$IN" "$OUT" >/dev/null 2>&1
+strace -qq -P "$OUT" -e fault=write:error=EIO:when=1 ./move -m rw "$IN" "$OUT" >/dev/null 2>&1
 code=$?
 set -e
 [[ $code -eq $EX_WRITE ]] || fail "write injection: exit $code, expected $EX_WRITE"
@@ -78,7 +309,7 @@ ok "inject write -> EIO on OUT"
 # 4) inject fsync failure on OUT
 echo "hello world" > "$IN"
 set +e
-strace -qq -P "$OUT" -e fault=fsync:error=EIO:when=1 ./move "$IN" "$OUT" >/dev/null 2>&1
+strace -qq -P "$OUT" -e fault=fsync:error=EIO:when=1 ./move -m copy "$IN" "$OUT" >/dev/null 2>&1
 code=$?
 set -e
 [[ $code -eq $EX_FSYNC ]] || fail "fsync injection: exit $code, expected $EX_FSYNC"
@@ -89,7 +320,7 @@ ok "inject fsync -> EIO on OUT"
 # 5) inject close failure on OUT
 echo "hello world" > "$IN"
 set +e
-strace -qq -P "$OUT" -e fault=close:error=EIO:when=1 ./move "$IN" "$OUT" >/dev/null 2>&1
+strace -qq -P "$OUT" -e fault=close:error=EIO:when=1 ./move -m copy "$IN" "$OUT" >/dev/null 2>&1
 code=$?
 set -e
 [[ $code -eq $EX_CLOSE_OUT ]] || fail "close(out) injection: exit $code, expected $EX_CLOSE_OUT"
@@ -100,7 +331,7 @@ ok "inject close -> EIO on OUT"
 # 6) inject read failure on IN
 echo "hello world" > "$IN"
 set +e
-strace -qq -P "$IN" -e fault=read:error=EIO:when=1 ./move "$IN" "$OUT" >/dev/null 2>&1
+strace -qq -P "$IN" -e fault=read:error=EIO:when=1 ./move -m rw "$IN" "$OUT" >/dev/null 2>&1
 code=$?
 set -e
 [[ $code -eq $EX_READ ]] || fail "read injection: exit $code, expected $EX_READ"
@@ -108,12 +339,118 @@ set -e
 [[ ! -e "$OUT" ]] || fail "outfile must be removed after read failure"
 ok "inject read -> EIO on IN"
 
+# 6b) a kernel copy that fails for real is not retried another way
+echo "hello world" > "$IN"
+set +e
+strace -qq -P "$OUT" -e fault=ioctl:error=EOPNOTSUPP -e fault=copy_file_range:error=EIO:when=1 \
+  ./move -m copy "$IN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_COPY ]] || fail "copy_file_range injection: exit $code, expected $EX_COPY"
+[[ -e "$IN" ]] || fail "infile must remain after copy_file_range failure"
+[[ ! -e "$OUT" ]] || fail "outfile must be removed after copy_file_range failure"
+ok "inject copy_file_range -> EIO on OUT"
+
+# 6c) no reflink, no copy_file_range (EXDEV: another filesystem): sendfile
+echo "hello world" > "$IN"
+set +e
+strace -qq -P "$OUT" -e fault=ioctl:error=EOPNOTSUPP -e fault=copy_file_range:error=EXDEV \
+  ./move -m copy "$IN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_OK ]] || fail "fallback to sendfile: exit $code != $EX_OK"
+diff -u <(echo "hello world") "$OUT" >/dev/null || fail "fallback to sendfile: content mismatch"
+ok "fallback from FICLONE and copy_file_range"
+
+# 6c') no space for the data: fallocate fails before anything is copied
+echo "hello world" > "$IN"
+set +e
+strace -qq -P "$OUT" -e fault=fallocate:error=ENOSPC ./move -m copy "$IN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_WRITE ]] || fail "fallocate injection: exit $code, expected $EX_WRITE"
+[[ -e "$IN" && ! -e "$OUT" ]] || fail "fallocate injection: infile must remain, outfile must go"
+ok "inject fallocate -> ENOSPC on OUT"
+
+# 6c'') infile shrinks under the copy (read() says EOF after 1 MiB): outfile
+#       ends there too, not at the size fallocate reserved
+head -c 3000000 "$TMPDIR/src" > "$IN"
+for r in "" -r; do
+  set +e
+  strace -qq -P "$IN" -e inject=read:retval=0:when=2 ./move $r -m rw "$IN" "$OUT" >/dev/null 2>&1
+  code=$?
+  set -e
+  [[ $code -eq $EX_OK ]] || fail "shrinking infile $r: exit $code != $EX_OK"
+  [[ $(stat -c %s "$OUT") -eq 1048576 ]] || fail "shrinking infile $r: outfile is $(stat -c %s "$OUT") bytes, expected 1048576"
+  head -c 3000000 "$TMPDIR/src" > "$IN"
+  rm -f "$OUT"
+done
+ok "inject read -> EOF: outfile as long as what was read"
+
+# 6c''') -r: a copy that fails after two checkpoints (128 MiB each) keeps
+#       outfile and its sidecar, and the next run continues from there
+BIGIN="$TMPDIR/big"
+rm -f "$BIGIN"
+truncate -s 300M "$BIGIN"
+for mb in 0 130 260; do
+  head -c 100000 "$TMPDIR/src" | dd of="$BIGIN" bs=1M seek=$mb conv=notrunc status=none
+done
+cp --sparse=always "$BIGIN" "$IN"
+set +e
+strace -qq -P "$OUT" -e fault=ioctl:error=EOPNOTSUPP -e fault=copy_file_range:error=EIO:when=3 \
+  ./move -r -m copy "$IN" "$OUT" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_COPY ]] || fail "-r injection: exit $code, expected $EX_COPY"
+[[ -e "$IN" && -e "$OUT" && -e "$OUT.move-ckpt" ]] || fail "-r: infile, partial outfile and checkpoint must remain"
+./move -n -r -m copy "$IN" "$OUT" 2> "$TMPDIR/err" || fail "-r resume: exit $?"
+grep -q "resuming at 256.0 MiB" "$TMPDIR/err" || fail "-r: should resume at the second checkpoint"
+cmp -s "$BIGIN" "$OUT" || fail "-r resume: content mismatch"
+[[ ! -e "$IN" && ! -e "$OUT.move-ckpt" ]] || fail "-r resume: infile and checkpoint should be removed"
+ok "inject copy_file_range -> EIO under -r, then resume"
+
+# 6c'''') -r on a slow infile (150 ms a read): progress shows up long
+#         before the first checkpoint, not only at the end
+head -c 24M /dev/urandom > "$IN"
+strace -qq -P "$IN" -e inject=read:delay_exit=150000 ./move -r -m rw "$IN" "$OUT" 2> "$TMPDIR/err" ||
+  fail "-r slow infile: exit $?"
+[[ $(grep -c "MiB/s" "$TMPDIR/err") -ge 2 ]] || fail "-r slow infile: no progress before the end"
+rm -f "$OUT"
+ok "inject read delays under -r: progress between checkpoints"
+
+# 6d) group commit: fdatasync fails for one outfile, which alone fails,
+#     with its infile kept; the directory fsync happens once for the group
+mkdir -p "$TMPDIR/g"
+for i in 1 2 3; do echo "g$i" > "$TMPDIR/g/in$i"; done
+printf '%s\t%s\n' "$TMPDIR/g/in1" "$TMPDIR/g/out1" "$TMPDIR/g/in2" "$TMPDIR/g/out2" \
+  "$TMPDIR/g/in3" "$TMPDIR/g/out3" > "$TMPDIR/g/list"
+set +e
+strace -qq -f -P "$TMPDIR/g/out2" -e fault=fdatasync:error=EIO \
+  ./move -m copy -j 1 -g -b "$TMPDIR/g/list" >/dev/null 2>&1
+code=$?
+set -e
+[[ $code -eq $EX_FSYNC ]] || fail "group fdatasync injection: exit $code, expected $EX_FSYNC"
+[[ -e "$TMPDIR/g/in2" && ! -e "$TMPDIR/g/out2" ]] || fail "group: the failed pair must keep infile, lose outfile"
+[[ ! -e "$TMPDIR/g/in1" && -e "$TMPDIR/g/out1" && ! -e "$TMPDIR/g/in3" && -e "$TMPDIR/g/out3" ]] ||
+  fail "group: the other pairs must be moved"
+for i in 1 3; do echo "g$i" > "$TMPDIR/g/in$i"; rm -f "$TMPDIR/g/out$i"; done
+dirsyncs=$(strace -f -e trace=fsync ./move -m copy -g -b "$TMPDIR/g/list" 2>&1 | grep -c 'fsync(')
+[[ $dirsyncs -eq 1 ]] || fail "group: $dirsyncs fsync calls, expected one for the directory"
+ok "inject fdatasync -> EIO in a group commit"
+
 # 7) LD_PRELOAD protection: infile containing PROTECT must not be deleted
 echo "secret" > "$TMPDIR/PROTECT_file.txt"
 set +e
 LD_PRELOAD="$(pwd)/libprotect.so" ./move "$TMPDIR/PROTECT_file.txt" "$TMPDIR/protected_out.txt" >/dev/null 2>&1
 code=$?
 set -e
+[[ $code -eq $EX_RENAME ]] || fail "LD_PRELOAD rename test: exit $code, expected $EX_RENAME (rename denied)"
+[[ -e "$TMPDIR/PROTECT_file.txt" && ! -e "$TMPDIR/protected_out.txt" ]] || fail "LD_PRELOAD rename test: nothing should move"
+ok "LD_PRELOAD test (PROTECT blocks rename)"
+set +e
+LD_PRELOAD="$(pwd)/libprotect.so" ./move -m copy "$TMPDIR/PROTECT_file.txt" "$TMPDIR/protected_out.txt" >/dev/null 2>&1
+code=$?
+set -e
 [[ $code -eq $EX_UNLINK_IN ]] || fail "LD_PRELOAD test: exit $code, expected $EX_UNLINK_IN (unlink denied)"
 [[ -e "$TMPDIR/PROTECT_file.txt" ]] || fail "LD_PRELOAD test: infile should not be deleted"
 diff -u <(echo "secret") "$TMPDIR/protected_out.txt" >/dev/null || fail "LD_PRELOAD test: content mismatch"